@@ -0,0 +1,178 @@
+#include "area_label_cache.h"
+#include "feature_rules.h"
+#include <QFontMetricsF>
+#include <algorithm>
+#include <cmath>
+
+namespace {
+constexpr qint64 pageBytes = qint64(AreaLabelCache::pageSize) *
+                             AreaLabelCache::pageSize * 4;
+}
+
+float AreaLabelCache::pointSize(bool isMajor, float zoom) {
+  return isMajor ? std::clamp(zoom * 10.0f, 8.0f, 30.0f)
+                 : std::clamp(zoom * 6.0f, 6.0f, 18.0f);
+}
+
+void AreaLabelCache::invalidate() { stale = true; }
+
+void AreaLabelCache::prepare(const std::vector<AreaLabel> &labels,
+                             const Projection &project) {
+  entries.clear();
+  entries.reserve(int(labels.size()));
+  for (const AreaLabel &label : labels)
+    entries.append({QString::fromStdString(label.name), project(label.center),
+                    label.isMajor});
+  atlases.clear();
+  atlasBytes = 0;
+  stale = false;
+}
+
+AreaLabelCache::Atlas &AreaLabelCache::atlasFor(int bucket) {
+  // Zooming away leaves the old buckets behind, drop them over budget
+  if (!atlases.contains(bucket) && atlasBytes >= spriteBudget) {
+    for (auto it = atlases.begin(); it != atlases.end();) {
+      atlasBytes -= it->pages.size() * pageBytes;
+      it = atlases.erase(it);
+    }
+  }
+  return atlases[bucket];
+}
+
+QRect AreaLabelCache::allocate(Atlas &atlas, int w, int h, int &page) {
+  if (w > pageSize || h > pageSize)
+    return QRect();
+
+  Page *current = atlas.pages.isEmpty() ? nullptr : &atlas.pages.last();
+  if (current && current->shelfX + w > pageSize) {
+    current->shelfY += current->shelfHeight;
+    current->shelfX = 0;
+    current->shelfHeight = 0;
+  }
+  if (!current || current->shelfY + h > pageSize) {
+    Page fresh;
+    fresh.pixmap = QPixmap(pageSize, pageSize);
+    fresh.pixmap.fill(Qt::transparent);
+    atlas.pages.append(fresh);
+    atlasBytes += pageBytes;
+    current = &atlas.pages.last();
+  }
+
+  page = atlas.pages.size() - 1;
+  QRect rect(current->shelfX, current->shelfY, w, h);
+  current->shelfX += w + 1; // A pixel apart, no bleeding when filtered
+  current->shelfHeight = std::max(current->shelfHeight, h + 1);
+  return rect;
+}
+
+// Rasterizes one name with its halo at the bucket's font size
+AreaLabelCache::Sprite AreaLabelCache::render(Atlas &atlas, const Entry &entry,
+                                              float bucketZoom,
+                                              const QFont &baseFont) {
+  QFont font = baseFont;
+  font.setPointSizeF(pointSize(entry.isMajor, bucketZoom));
+  font.setBold(entry.isMajor);
+
+  // Step 1: Sprite box around the text, in logical pixels at the bucket size
+  const QFontMetricsF fm(font);
+  const QRectF textRect = fm.boundingRect(entry.name);
+  const qreal pad = haloWidth / 2 + 1;
+  const QSizeF size(textRect.width() + 2 * pad, textRect.height() + 2 * pad);
+  const QPointF baseline(pad - textRect.left(), pad - textRect.top());
+  // Where drawText put the baseline relative to the center
+  const QPointF anchorBaseline(-textRect.width() / 2, fm.ascent() / 2);
+
+  Sprite sprite;
+  sprite.offset = anchorBaseline - baseline +
+                  QPointF(size.width() / 2, size.height() / 2);
+  sprite.rasterScale = std::min({float(devicePixelRatio),
+                                 float((pageSize - 1) / size.width()),
+                                 float((pageSize - 1) / size.height())});
+
+  // Step 2: Place it in the atlas
+  const int w = int(std::ceil(size.width() * sprite.rasterScale));
+  const int h = int(std::ceil(size.height() * sprite.rasterScale));
+  const QRect rect = allocate(atlas, w, h, sprite.page);
+  if (rect.isNull())
+    return sprite; // page stays -1
+  sprite.source = QRectF(rect.topLeft(), size * sprite.rasterScale);
+
+  // Step 3: Halo as the text offset around a circle, then the fill
+  QPainter painter(&atlas.pages[sprite.page].pixmap);
+  painter.setRenderHint(QPainter::TextAntialiasing);
+  painter.translate(rect.topLeft());
+  painter.scale(sprite.rasterScale, sprite.rasterScale);
+  painter.setFont(font);
+  painter.setPen(Qt::white);
+  const qreal r = haloWidth / 2;
+  for (int i = 0; i < 8; ++i) {
+    const double angle = i * M_PI / 4;
+    painter.drawText(baseline + QPointF(r * std::cos(angle),
+                                        r * std::sin(angle)),
+                     entry.name);
+  }
+  painter.setPen(Qt::black);
+  painter.drawText(baseline, entry.name);
+  return sprite;
+}
+
+void AreaLabelCache::draw(QPainter &painter, const Camera &camera,
+                          const std::vector<AreaLabel> &labels,
+                          const Projection &project) {
+  const qreal dpr = painter.device()->devicePixelRatioF();
+  if (stale || dpr != devicePixelRatio) {
+    devicePixelRatio = dpr;
+    prepare(labels, project);
+  }
+
+  const float zoom = camera.zoom;
+  const int bucket = int(std::lround(std::log2(zoom) * bucketsPerOctave));
+  const float bucketZoom = std::exp2(float(bucket) / bucketsPerOctave);
+  Atlas &atlas = atlasFor(bucket);
+  const QTransform toScreen = painter.transform();
+  const QRectF screen(QPointF(), QSizeF(camera.viewport));
+
+  QVector<QVector<QPainter::PixmapFragment>> fragments;
+  for (int i = 0; i < entries.size(); ++i) {
+    const Entry &entry = entries[i];
+    if (!isVisibleAt(entry.isMajor ? FeatureClass::MajorAreaLabel
+                                   : FeatureClass::MinorAreaLabel,
+                     zoom))
+      continue;
+
+    // Off-screen names aren't rasterized; a name spans at most a couple
+    // of ems per character
+    const QPointF anchor = toScreen.map(entry.anchor);
+    const float size = pointSize(entry.isMajor, zoom);
+    const double reach = 2.0 * size * (entry.name.size() + 1);
+    if (!screen.adjusted(-reach, -reach, reach, reach).contains(anchor))
+      continue;
+
+    auto it = atlas.sprites.find(i);
+    if (it == atlas.sprites.end())
+      it = atlas.sprites.insert(i, render(atlas, entry, bucketZoom,
+                                          painter.font()));
+    const Sprite &sprite = it.value();
+    if (sprite.page < 0)
+      continue;
+
+    // Exact font size from the bucket's
+    const float scale = size / pointSize(entry.isMajor, bucketZoom);
+    if (fragments.size() <= sprite.page)
+      fragments.resize(sprite.page + 1);
+    fragments[sprite.page].append(QPainter::PixmapFragment::create(
+        anchor + sprite.offset * scale, sprite.source,
+        scale / sprite.rasterScale, scale / sprite.rasterScale));
+  }
+
+  painter.save();
+  painter.resetTransform();
+  painter.setRenderHint(QPainter::SmoothPixmapTransform);
+  for (int page = 0; page < fragments.size(); ++page) {
+    if (!fragments[page].isEmpty())
+      painter.drawPixmapFragments(fragments[page].constData(),
+                                  fragments[page].size(),
+                                  atlas.pages[page].pixmap);
+  }
+  painter.restore();
+}
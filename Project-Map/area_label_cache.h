@@ -0,0 +1,68 @@
+#pragma once
+#include "camera.h"
+#include "graph.h"
+#include <QHash>
+#include <QPainter>
+#include <QPixmap>
+#include <QVector>
+#include <functional>
+
+// Area names prerendered with their halo into sprite atlases, one set of
+// pages per zoom bucket. A sprite is rasterized the first time its label is
+// on screen at that bucket; every later frame draws all visible names with
+// one drawPixmapFragments call per page, scaled to the exact font size.
+// Names are anchored in map units and drawn upright in screen space.
+class AreaLabelCache {
+public:
+  using Projection = std::function<QPointF(const QPointF &lonLat)>;
+
+  static constexpr int bucketsPerOctave = 4; // Zoom steps sharing sprites
+  static constexpr int pageSize = 1024;      // Atlas page, pixels square
+  static constexpr float haloWidth = 3.0f;
+  static constexpr qint64 spriteBudget = 32ll * 1024 * 1024; // Page bytes
+
+  void invalidate(); // Labels changed, drop all sprites
+  // With the map transform set on painter; the names themselves are drawn
+  // without it, at their font size in logical pixels
+  void draw(QPainter &painter, const Camera &camera,
+            const std::vector<AreaLabel> &labels, const Projection &project);
+
+  // Same sizes the per-frame QFont code used
+  static float pointSize(bool isMajor, float zoom);
+
+private:
+  struct Entry {
+    QString name;
+    QPointF anchor; // Projected center, map units
+    bool isMajor;
+  };
+  struct Sprite {
+    int page = -1;       // -1: didn't fit, not drawn
+    QRectF source;       // Pixels in the page
+    QPointF offset;      // Sprite center from the anchor, pixels at bucket size
+    float rasterScale = 1; // Sprite pixels per logical pixel
+  };
+  struct Page {
+    QPixmap pixmap;
+    int shelfX = 0;
+    int shelfY = 0;
+    int shelfHeight = 0;
+  };
+  // Sprites of one zoom bucket
+  struct Atlas {
+    QVector<Page> pages;
+    QHash<int, Sprite> sprites; // By entry index
+  };
+
+  void prepare(const std::vector<AreaLabel> &labels, const Projection &project);
+  Atlas &atlasFor(int bucket);
+  Sprite render(Atlas &atlas, const Entry &entry, float bucketZoom,
+                const QFont &baseFont);
+  QRect allocate(Atlas &atlas, int w, int h, int &page);
+
+  QVector<Entry> entries;
+  bool stale = true;
+  QHash<int, Atlas> atlases; // By zoom bucket
+  qint64 atlasBytes = 0;
+  qreal devicePixelRatio = 0;
+};
@@ -0,0 +1,44 @@
+#pragma once
+#include <QMatrix4x4>
+#include <QRectF>
+#include <QSize>
+
+// View state of the map: a pixel-space orthographic projection centered on
+// the viewport, scaled by zoom and translated by pan (in map units).
+struct Camera {
+  float zoom = 1.0f;
+  float panX = 0;
+  float panY = 0;
+  QSize viewport;
+
+  // Map-space rectangle currently on screen
+  QRectF visibleMapRect() const {
+    double halfW = viewport.width() / (2.0 * zoom);
+    double halfH = viewport.height() / (2.0 * zoom);
+    return QRectF(QPointF(-halfW - panX, -halfH - panY),
+                  QPointF(halfW - panX, halfH - panY));
+  }
+
+  // Map space to clip space, for the map shaders
+  QMatrix4x4 viewMatrix() const {
+    QMatrix4x4 m;
+    m.ortho(-viewport.width() / 2.0f, viewport.width() / 2.0f,
+            -viewport.height() / 2.0f, viewport.height() / 2.0f, -1.0f, 1.0f);
+    m.scale(zoom, zoom);
+    m.translate(panX, panY);
+    return m;
+  }
+
+  // Map space to clip space for geometry stored relative to origin, in
+  // steps of unit map units. Offsets are composed in double, so large map
+  // coordinates cancel before anything is rounded to float.
+  QMatrix4x4 localMatrix(const QPointF &origin, double unit) const {
+    QMatrix4x4 m;
+    m.ortho(-viewport.width() / 2.0f, viewport.width() / 2.0f,
+            -viewport.height() / 2.0f, viewport.height() / 2.0f, -1.0f, 1.0f);
+    m.translate(float(zoom * (origin.x() + panX)),
+                float(zoom * (origin.y() + panY)));
+    m.scale(float(zoom * unit), float(zoom * unit));
+    return m;
+  }
+};
@@ -0,0 +1,108 @@
+#include "feature_picker.h"
+#include <algorithm>
+#include <limits>
+
+bool pointInRing(const QPointF *ring, int count, const QPointF &pt) {
+  if (count < 3)
+    return false;
+
+  const double px = pt.x();
+  const double py = pt.y();
+  int crossings = 0;
+
+  // Edge (j, i) crosses the horizontal ray when its ends straddle py and the
+  // crossing lies right of px. Horizontal edges divide by zero, but their
+  // straddle test is false so the result is masked out.
+  for (int i = 0, j = count - 1; i < count; j = i++) {
+    const double xi = ring[i].x(), yi = ring[i].y();
+    const double xj = ring[j].x(), yj = ring[j].y();
+    const bool straddles = (yi > py) != (yj > py);
+    const double xCross = xj + (py - yj) * (xi - xj) / (yi - yj);
+    crossings += straddles & (px < xCross);
+  }
+  return crossings & 1;
+}
+
+double squaredDistanceToPolyline(const QPointF *nodes, int count,
+                                 const QPointF &pt) {
+  double best = std::numeric_limits<double>::max();
+  for (int i = 1; i < count; ++i) {
+    const double ax = nodes[i - 1].x(), ay = nodes[i - 1].y();
+    const double dx = nodes[i].x() - ax, dy = nodes[i].y() - ay;
+    const double len2 = dx * dx + dy * dy;
+    double t = ((pt.x() - ax) * dx + (pt.y() - ay) * dy) / (len2 > 0 ? len2 : 1);
+    t = std::clamp(t, 0.0, 1.0);
+    const double ex = ax + t * dx - pt.x();
+    const double ey = ay + t * dy - pt.y();
+    best = std::min(best, ex * ex + ey * ey);
+  }
+  return best;
+}
+
+PickResult pickFeature(const Graph &graph, const QPointF &pt,
+                       double roadTolerance) {
+  PickResult result;
+  QVector<int> hits;
+
+  // Step 1: Nearest road within the tolerance
+  QRectF probe(pt.x() - roadTolerance, pt.y() - roadTolerance,
+               2 * roadTolerance, 2 * roadTolerance);
+  graph.roadIndex.query(probe, hits);
+  double best = roadTolerance * roadTolerance;
+  for (int i : hits) {
+    const Road &road = graph.roads[i];
+    double d = squaredDistanceToPolyline(road.nodes.constData(),
+                                         road.nodes.size(), pt);
+    if (d <= best) {
+      best = d;
+      result = {PickResult::Road, i};
+    }
+  }
+  if (result.kind != PickResult::None)
+    return result;
+
+  // Step 2: Polygons containing the point. Later entries are drawn on top.
+  QRectF point(pt, QSizeF(0, 0));
+  auto pickArea = [&](const RTree &index, const QList<PolygonArea> &areas,
+                      PickResult::Kind kind) {
+    hits.clear();
+    index.query(point, hits);
+    std::sort(hits.begin(), hits.end());
+    for (auto it = hits.crbegin(); it != hits.crend(); ++it) {
+      const PolygonArea &area = areas[*it];
+      bool inHole = false;
+      for (const auto &hole : area.holes)
+        inHole = inHole || pointInRing(hole.constData(), hole.size(), pt);
+      if (!inHole && pointInRing(area.nodes.constData(), area.nodes.size(), pt)) {
+        result = {kind, *it};
+        return true;
+      }
+    }
+    return false;
+  };
+
+  if (pickArea(graph.buildingIndex, graph.buildings, PickResult::Building))
+    return result;
+  pickArea(graph.polygonIndex, graph.polygons, PickResult::Polygon);
+  return result;
+}
+
+QMap<QString, QString> pickedTags(const Graph &graph, const PickResult &pick) {
+  switch (pick.kind) {
+  case PickResult::Road: {
+    const Road &road = graph.roads[pick.index];
+    QMap<QString, QString> tags;
+    tags["highway"] = road.type;
+    if (!road.name.isEmpty())
+      tags["name"] = road.name;
+    return tags;
+  }
+  case PickResult::Building:
+    return graph.buildings[pick.index].tags;
+  case PickResult::Polygon:
+    return graph.polygons[pick.index].tags;
+  case PickResult::None:
+    break;
+  }
+  return {};
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include "graph.h"
+#include <QMap>
+#include <QPointF>
+#include <QString>
+
+struct PickResult {
+  enum Kind { None, Road, Building, Polygon };
+  Kind kind = None;
+  int index = -1; // Into graph.roads, graph.buildings or graph.polygons
+
+  bool operator==(const PickResult &o) const {
+    return kind == o.kind && index == o.index;
+  }
+  bool operator!=(const PickResult &o) const { return !(*this == o); }
+};
+
+// Finds the feature under a map-space point. Candidates come from the graph
+// R-trees, then exact tests run on the few boxes that were hit. Roads win over
+// buildings, buildings over landuse polygons.
+PickResult pickFeature(const Graph &graph, const QPointF &pt,
+                       double roadTolerance);
+
+// Tags of a picked building/polygon, or name/highway of a picked road
+QMap<QString, QString> pickedTags(const Graph &graph, const PickResult &pick);
+
+// Branch-free crossing-number test over a ring, written so the compiler can
+// vectorize the loop
+bool pointInRing(const QPointF *ring, int count, const QPointF &pt);
+
+// Smallest squared distance from pt to the polyline
+double squaredDistanceToPolyline(const QPointF *nodes, int count,
+                                 const QPointF &pt);
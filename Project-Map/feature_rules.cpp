@@ -0,0 +1,75 @@
+#include "feature_rules.h"
+#include "graph.h"
+#include <QHash>
+
+namespace {
+
+// Zoom is pixels per map unit; the whole ~1000 unit city fits at about 0.9
+const VisibilityRule rules[featureClassCount] = {
+    {5.0f},       // Footway
+    {5.0f},       // Path
+    {3.0f},       // Service
+    {1.8f},       // Residential
+    {1.8f},       // Unclassified
+    {},           // Tertiary
+    {},           // Secondary
+    {},           // Trunk
+    {},           // Primary
+    {},           // Highway
+    {},           // Motorway
+    {2.5f},       // Building
+    {1.5f},       // OtherArea
+    {},           // ResidentialArea
+    {},           // Cemetery
+    {},           // Grass
+    {},           // Forest
+    {0.0f, 2.0f}, // MajorAreaLabel
+    {0.0f, 2.0f}, // MinorAreaLabel
+};
+
+} // namespace
+
+const VisibilityRule &visibilityRule(FeatureClass cls) {
+  return rules[int(cls)];
+}
+
+bool isVisibleAt(FeatureClass cls, float zoom) {
+  const VisibilityRule &rule = rules[int(cls)];
+  return zoom >= rule.minZoom && zoom <= rule.maxZoom;
+}
+
+bool isVisibleBetween(FeatureClass cls, float minZoom, float maxZoom) {
+  const VisibilityRule &rule = rules[int(cls)];
+  return maxZoom >= rule.minZoom && minZoom <= rule.maxZoom;
+}
+
+FeatureClass roadClass(const QString &highwayType) {
+  static const QHash<QString, FeatureClass> classes = {
+      {"footway", FeatureClass::Footway},
+      {"path", FeatureClass::Path},
+      {"service", FeatureClass::Service},
+      {"residential", FeatureClass::Residential},
+      {"unclassified", FeatureClass::Unclassified},
+      {"tertiary", FeatureClass::Tertiary},
+      {"secondary", FeatureClass::Secondary},
+      {"trunk", FeatureClass::Trunk},
+      {"primary", FeatureClass::Primary},
+      {"highway", FeatureClass::Highway},
+      {"motorway", FeatureClass::Motorway},
+  };
+  return classes.value(highwayType, FeatureClass::Count);
+}
+
+FeatureClass areaClass(const PolygonArea &area) {
+  QString type = area.tags.value("landuse", area.tags.value("leisure"));
+
+  if (type == "grass" || type == "meadow")
+    return FeatureClass::Grass;
+  if (type == "forest")
+    return FeatureClass::Forest;
+  if (type == "cemetery")
+    return FeatureClass::Cemetery;
+  if (type == "residential")
+    return FeatureClass::ResidentialArea;
+  return FeatureClass::OtherArea;
+}
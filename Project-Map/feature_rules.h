@@ -0,0 +1,51 @@
+#pragma once
+#include <QString>
+
+struct PolygonArea;
+
+// Everything the map draws, grouped by what decides its zoom range. Road
+// classes come first, bottom to top in drawing order.
+enum class FeatureClass {
+  Footway,
+  Path,
+  Service,
+  Residential,
+  Unclassified,
+  Tertiary,
+  Secondary,
+  Trunk,
+  Primary,
+  Highway,
+  Motorway,
+  Building,
+  OtherArea, // Landuse/leisure kinds, broad ones below specific ones
+  ResidentialArea,
+  Cemetery,
+  Grass,
+  Forest,
+  MajorAreaLabel,
+  MinorAreaLabel,
+  Count
+};
+
+constexpr int featureClassCount = int(FeatureClass::Count);
+constexpr int roadClassCount = int(FeatureClass::Motorway) + 1;
+// Landuse/leisure classes run from OtherArea to Forest
+constexpr int firstAreaClass = int(FeatureClass::OtherArea);
+constexpr int areaClassCount = int(FeatureClass::Forest) - firstAreaClass + 1;
+
+// A class is drawn while minZoom <= zoom <= maxZoom
+struct VisibilityRule {
+  float minZoom = 0.0f;
+  float maxZoom = 1e9f;
+};
+
+const VisibilityRule &visibilityRule(FeatureClass cls);
+bool isVisibleAt(FeatureClass cls, float zoom);
+// True when the class shows anywhere in [minZoom, maxZoom]
+bool isVisibleBetween(FeatureClass cls, float minZoom, float maxZoom);
+
+// Road class of an OSM highway type; FeatureClass::Count for types the map
+// does not draw. Resolved once at load, see Graph::classifyFeatures.
+FeatureClass roadClass(const QString &highwayType);
+FeatureClass areaClass(const PolygonArea &area); // Landuse/leisure kind
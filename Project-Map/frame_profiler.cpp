@@ -0,0 +1,249 @@
+#include "frame_profiler.h"
+#include <QDebug>
+#include <QFile>
+#include <QOpenGLContext>
+#include <QPainter>
+#include <algorithm>
+
+const char *FrameProfiler::passName(Pass pass) {
+  static const char *names[PassCount] = {
+      "background",  "buildings", "polygons",   "roads",
+      "road labels", "composite", "area labels"};
+  return names[pass];
+}
+
+FrameProfiler::FrameProfiler() { clock.start(); }
+
+FrameProfiler::~FrameProfiler() = default;
+
+void FrameProfiler::initialize() {
+  QOpenGLContext *context = QOpenGLContext::currentContext();
+  // Timer queries need desktop GL 3.3 or GL_ARB_timer_query
+  gpuTimers = context && !context->isOpenGLES() &&
+              (context->format().version() >= qMakePair(3, 3) ||
+               context->hasExtension("GL_ARB_timer_query"));
+  if (!gpuTimers)
+    qDebug() << "GPU timer queries unavailable, profiling CPU time only";
+}
+
+void FrameProfiler::cleanup() {
+  for (QuerySlot &slot : querySlots) {
+    slot.queries.clear();
+    slot.passes.clear();
+  }
+  queryActive = false;
+}
+
+void FrameProfiler::setEnabled(bool on) {
+  if (on == enabled)
+    return;
+  enabled = on;
+  // Queries of a paused stretch would land on the wrong frames
+  for (QuerySlot &slot : querySlots)
+    slot.passes.clear();
+  frames.clear();
+}
+
+void FrameProfiler::beginFrame() {
+  if (!enabled)
+    return;
+
+  ++frameNumber;
+  QuerySlot &slot = querySlots[frameNumber % queryLatency];
+  collect(slot);
+  slot.frame = frameNumber;
+
+  current = FrameRecord();
+  current.frame = frameNumber;
+  frameStart = clock.nsecsElapsed();
+  inFrame = true;
+}
+
+void FrameProfiler::endFrame() {
+  if (!enabled || !inFrame)
+    return;
+  inFrame = false;
+
+  current.cpuMs = (clock.nsecsElapsed() - frameStart) / 1e6;
+  current.gpuValid = !gpuTimers; // Nothing to wait for
+  frames.append(current);
+  if (frames.size() > historySize)
+    frames.removeFirst();
+}
+
+void FrameProfiler::begin(Pass pass) {
+  if (!enabled || !inFrame)
+    return;
+  passStart[pass] = clock.nsecsElapsed();
+
+  // GL_TIME_ELAPSED queries can't nest
+  if (!gpuTimers || queryActive)
+    return;
+  QuerySlot &slot = querySlots[frameNumber % queryLatency];
+  if (slot.passes.size() == int(slot.queries.size())) {
+    auto query = std::make_unique<QOpenGLTimerQuery>();
+    if (!query->create()) {
+      gpuTimers = false;
+      return;
+    }
+    slot.queries.push_back(std::move(query));
+  }
+  slot.queries[slot.passes.size()]->begin();
+  slot.passes.append(pass);
+  queryActive = true;
+}
+
+void FrameProfiler::end(Pass pass) {
+  if (!enabled || !inFrame)
+    return;
+  current.passCpuMs[pass] += (clock.nsecsElapsed() - passStart[pass]) / 1e6;
+
+  if (queryActive) {
+    QuerySlot &slot = querySlots[frameNumber % queryLatency];
+    slot.queries[slot.passes.size() - 1]->end();
+    queryActive = false;
+  }
+}
+
+void FrameProfiler::addCpuTime(Pass pass, qint64 nanos) {
+  if (!enabled || !inFrame)
+    return;
+  current.passCpuMs[pass] += nanos / 1e6;
+}
+
+// Reads the GPU times of the frame that last used this slot
+void FrameProfiler::collect(QuerySlot &slot) {
+  if (slot.passes.isEmpty())
+    return;
+
+  FrameRecord *target = record(slot.frame);
+  for (int i = 0; i < slot.passes.size(); ++i) {
+    const quint64 nanos = slot.queries[i]->waitForResult();
+    if (target)
+      target->passGpuMs[slot.passes[i]] += nanos / 1e6;
+  }
+  if (target)
+    target->gpuValid = true;
+  slot.passes.clear();
+}
+
+FrameProfiler::FrameRecord *FrameProfiler::record(quint64 frame) {
+  for (int i = frames.size() - 1; i >= 0; --i) {
+    if (frames[i].frame == frame)
+      return &frames[i];
+    if (frames[i].frame < frame)
+      break;
+  }
+  return nullptr;
+}
+
+bool FrameProfiler::exportCsv(const QString &fileName) const {
+  QFile file(fileName);
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    return false;
+
+  QByteArray header = "frame,cpu_ms";
+  for (int p = 0; p < PassCount; ++p)
+    header += QByteArray(",") + passName(Pass(p)) + " cpu_ms";
+  for (int p = 0; p < PassCount; ++p)
+    header += QByteArray(",") + passName(Pass(p)) + " gpu_ms";
+  file.write(header + '\n');
+
+  for (const FrameRecord &f : frames) {
+    QByteArray line = QByteArray::number(f.frame) + ',' +
+                      QByteArray::number(f.cpuMs, 'f', 3);
+    for (int p = 0; p < PassCount; ++p)
+      line += ',' + QByteArray::number(f.passCpuMs[p], 'f', 3);
+    for (int p = 0; p < PassCount; ++p) {
+      line += ',';
+      if (f.gpuValid && gpuTimers && hasGpuTime(Pass(p)))
+        line += QByteArray::number(f.passGpuMs[p], 'f', 3);
+    }
+    file.write(line + '\n');
+  }
+  return true;
+}
+
+void FrameProfiler::drawOverlay(QPainter &painter, const QRect &area) const {
+  if (frames.isEmpty())
+    return;
+
+  // Averages over the history
+  double cpu[PassCount] = {}, gpu[PassCount] = {};
+  int gpuFrames = 0;
+  QVector<double> frameMs;
+  for (const FrameRecord &f : frames) {
+    frameMs.append(f.cpuMs);
+    for (int p = 0; p < PassCount; ++p)
+      cpu[p] += f.passCpuMs[p];
+    if (f.gpuValid && gpuTimers) {
+      ++gpuFrames;
+      for (int p = 0; p < PassCount; ++p)
+        gpu[p] += f.passGpuMs[p];
+    }
+  }
+  std::sort(frameMs.begin(), frameMs.end());
+  double mean = 0;
+  for (double ms : frameMs)
+    mean += ms;
+  mean /= frameMs.size();
+  const double p95 = frameMs[int(0.95 * (frameMs.size() - 1))];
+
+  const int lineHeight = 16;
+  const int histogramHeight = 60;
+  const QRect panel(area.left() + 10, area.top() + 10, 300,
+                    lineHeight * (PassCount + 3) + histogramHeight + 20);
+
+  painter.save();
+  painter.resetTransform();
+  painter.setPen(Qt::NoPen);
+  painter.setBrush(QColor(0, 0, 0, 170));
+  painter.drawRect(panel);
+
+  QFont font = painter.font();
+  font.setPixelSize(12);
+  painter.setFont(font);
+  painter.setPen(Qt::white);
+
+  int y = panel.top() + lineHeight;
+  const int x = panel.left() + 8;
+  painter.drawText(x, y,
+                   QString("Frame CPU %1 ms avg, %2 ms p95 (%3 frames)")
+                       .arg(mean, 0, 'f', 2)
+                       .arg(p95, 0, 'f', 2)
+                       .arg(frames.size()));
+  y += lineHeight;
+  painter.drawText(x, y, "Pass");
+  painter.drawText(x + 120, y, "CPU ms");
+  painter.drawText(x + 200, y, "GPU ms");
+  for (int p = 0; p < PassCount; ++p) {
+    y += lineHeight;
+    const QString gpuText =
+        gpuFrames > 0 && hasGpuTime(Pass(p))
+            ? QString::number(gpu[p] / gpuFrames, 'f', 3)
+            : "n/a";
+    painter.drawText(x, y, passName(Pass(p)));
+    painter.drawText(x + 120, y,
+                     QString::number(cpu[p] / frames.size(), 'f', 3));
+    painter.drawText(x + 200, y, gpuText);
+  }
+
+  // Frame-time histogram, 1 ms buckets up to two 60 Hz frames
+  const int bucketCount = 33;
+  QVector<int> buckets(bucketCount, 0);
+  for (double ms : frameMs)
+    ++buckets[std::min(bucketCount - 1, int(ms))];
+  const int maxCount = *std::max_element(buckets.begin(), buckets.end());
+
+  const QRect chart(x, y + 10, panel.width() - 16, histogramHeight);
+  const double barWidth = chart.width() / double(bucketCount);
+  painter.setPen(Qt::NoPen);
+  for (int b = 0; b < bucketCount; ++b) {
+    const double h = chart.height() * buckets[b] / double(maxCount);
+    // Green within a 60 Hz frame, red past it
+    painter.setBrush(b < 16 ? QColor(90, 200, 90) : QColor(220, 80, 60));
+    painter.drawRect(QRectF(chart.left() + b * barWidth, chart.bottom() - h,
+                            barWidth - 1, h));
+  }
+  painter.restore();
+}
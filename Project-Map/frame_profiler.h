@@ -0,0 +1,90 @@
+#pragma once
+#include <QElapsedTimer>
+#include <QList>
+#include <QOpenGLTimerQuery>
+#include <QRect>
+#include <QString>
+#include <QVector>
+#include <memory>
+
+class QPainter;
+
+// CPU and GPU cost of each render pass, per frame. CPU times are what the
+// pass took to submit; GPU times come from GL_TIME_ELAPSED queries that are
+// read back a few frames later, so they never stall the pipeline. Passes
+// may run several times in a frame (once per cached raster tile) and are
+// summed, but must not nest. Needs the GL context current except for the
+// read-only accessors.
+class FrameProfiler {
+public:
+  enum Pass {
+    Background,
+    Buildings,
+    Polygons,
+    Roads,
+    RoadLabels,
+    Composite,  // Cached raster tiles to the screen
+    AreaLabels, // Painted by the GUI thread, CPU only
+    PassCount
+  };
+  static const char *passName(Pass pass);
+  static bool hasGpuTime(Pass pass) { return pass != AreaLabels; }
+
+  static constexpr int historySize = 600;  // Frames kept for the HUD and CSV
+  static constexpr int queryLatency = 3;   // Frames before reading GPU times
+
+  struct FrameRecord {
+    quint64 frame = 0;
+    double cpuMs = 0; // Whole frame
+    double passCpuMs[PassCount] = {};
+    double passGpuMs[PassCount] = {};
+    bool gpuValid = false; // GPU times arrived
+  };
+
+  FrameProfiler();
+  ~FrameProfiler();
+
+  void initialize(); // Detects timer query support
+  void cleanup();
+
+  // Off by default; begin/end cost nothing while disabled
+  void setEnabled(bool on);
+  bool isEnabled() const { return enabled; }
+  bool hasGpuTimers() const { return gpuTimers; }
+
+  void beginFrame();
+  void endFrame();
+  void begin(Pass pass);
+  void end(Pass pass);
+  // CPU time of a pass measured elsewhere, between beginFrame and endFrame
+  void addCpuTime(Pass pass, qint64 nanos);
+
+  const QList<FrameRecord> &history() const { return frames; }
+  bool exportCsv(const QString &fileName) const;
+
+  // Frame-time histogram and per-pass averages, in widget pixels
+  void drawOverlay(QPainter &painter, const QRect &area) const;
+
+private:
+  // GPU queries issued in one frame, reused queryLatency frames later
+  struct QuerySlot {
+    quint64 frame = 0;
+    std::vector<std::unique_ptr<QOpenGLTimerQuery>> queries;
+    QVector<Pass> passes; // Pass of each used query
+  };
+
+  void collect(QuerySlot &slot);
+  FrameRecord *record(quint64 frame);
+
+  bool enabled = false;
+  bool gpuTimers = false;
+  bool inFrame = false;
+  bool queryActive = false;
+  quint64 frameNumber = 0;
+  QElapsedTimer clock;
+  qint64 frameStart = 0;
+  qint64 passStart[PassCount] = {};
+  FrameRecord current;
+  QuerySlot querySlots[queryLatency];
+  QList<FrameRecord> frames;
+};
@@ -0,0 +1,153 @@
+#include "frame_scheduler.h"
+#include <QDebug>
+#include <QOpenGLWidget>
+#include <QScreen>
+#include <algorithm>
+#include <cmath>
+
+FrameScheduler::FrameScheduler(QOpenGLWidget *w) : QObject(w), widget(w) {
+  connect(widget, &QOpenGLWidget::frameSwapped, this,
+          &FrameScheduler::frameSwapped);
+}
+
+// Seconds since the previous pan or zoom event; a long pause restarts the
+// velocity estimate
+double FrameScheduler::sinceLastInput() {
+  const bool fresh = velocityTimer.isValid() &&
+                     velocityTimer.elapsed() < velocityTimeoutMs;
+  const double seconds = fresh ? velocityTimer.nsecsElapsed() / 1e9 : 0.0;
+  velocityTimer.start();
+  if (!fresh) {
+    panSpeed = QPointF();
+    zoomSpeed = 0;
+  }
+  return seconds;
+}
+
+void FrameScheduler::addPan(const QPointF &pixels) {
+  if (pixels.isNull())
+    return;
+  const double dt = sinceLastInput();
+  if (dt > 0)
+    panSpeed += (pixels / dt - panSpeed) * velocitySmoothing;
+  if (pending.isEmpty())
+    inputTimer.start();
+  pending.pan += pixels;
+  ++pending.events;
+  requestFrame();
+}
+
+void FrameScheduler::addZoom(double factor, const QPointF &anchor) {
+  if (factor == 1.0 || factor <= 0.0)
+    return;
+  const double dt = sinceLastInput();
+  if (dt > 0)
+    zoomSpeed += (std::log2(factor) / dt - zoomSpeed) * velocitySmoothing;
+  if (pending.isEmpty())
+    inputTimer.start();
+  pending.zoomFactor *= factor;
+  pending.zoomAnchor = anchor;
+  ++pending.events;
+  requestFrame();
+}
+
+void FrameScheduler::requestFrame() {
+  dirty = true;
+  // A frame that never swaps (hidden widget) must not block the next one
+  if (frameInFlight && requestTimer.elapsed() < 250)
+    return;
+
+  frameInFlight = true;
+  requestTimer.start();
+  widget->update();
+}
+
+QPointF FrameScheduler::panVelocity() const {
+  if (!velocityTimer.isValid() || velocityTimer.elapsed() >= velocityTimeoutMs)
+    return QPointF();
+  return panSpeed;
+}
+
+double FrameScheduler::zoomVelocity() const {
+  if (!velocityTimer.isValid() || velocityTimer.elapsed() >= velocityTimeoutMs)
+    return 0.0;
+  return zoomSpeed;
+}
+
+// Same transform as MapWidget::applyInput, with the velocity as input
+Camera FrameScheduler::predict(const Camera &camera, double seconds) const {
+  Camera predicted = camera;
+  predicted.zoom =
+      std::clamp(float(camera.zoom * std::exp2(zoomVelocity() * seconds)),
+                 0.9f, 60.0f);
+  const QPointF pan = panVelocity() * seconds;
+  predicted.panX += pan.x() / predicted.zoom;
+  predicted.panY -= pan.y() / predicted.zoom;
+  return predicted;
+}
+
+FrameScheduler::Input FrameScheduler::takeInput() {
+  Input input = pending;
+  pending = Input();
+  dirty = false;
+
+  if (input.isEmpty())
+    frameInput.invalidate();
+  else
+    frameInput = inputTimer;
+  events += input.events;
+  return input;
+}
+
+void FrameScheduler::frameSwapped() {
+  frameInFlight = false;
+  ++frames;
+
+  // Late: more than one vsync since the previous swap while frames were
+  // wanted back to back. Every extra vsync in between is a dropped frame.
+  if (swapTimer.isValid() && continuous) {
+    const double intervalMs = swapTimer.nsecsElapsed() / 1e6;
+    const double vsync = vsyncMs();
+    if (intervalMs > 1.5 * vsync) {
+      ++late;
+      dropped += int(std::lround(intervalMs / vsync)) - 1;
+    }
+  }
+  swapTimer.start();
+
+  if (frameInput.isValid()) {
+    inputLatencyNanos += frameInput.nsecsElapsed();
+    ++latencySamples;
+    frameInput.invalidate();
+  }
+
+  if (frames == statsInterval)
+    reportStats();
+
+  // Input that arrived while this frame was rendering
+  continuous = dirty;
+  if (dirty)
+    requestFrame();
+}
+
+double FrameScheduler::vsyncMs() const {
+  const QScreen *screen = widget->screen();
+  const double rate = screen ? screen->refreshRate() : 60.0;
+  return 1000.0 / (rate > 0 ? rate : 60.0);
+}
+
+void FrameScheduler::reportStats() {
+  qDebug().nospace() << frames << " frames for " << events
+                     << " input events, " << late << " late, " << dropped
+                     << " dropped vsyncs, "
+                     << (latencySamples > 0
+                             ? inputLatencyNanos / 1e6 / latencySamples
+                             : 0.0)
+                     << " ms input to swap";
+  frames = 0;
+  events = 0;
+  late = 0;
+  dropped = 0;
+  inputLatencyNanos = 0;
+  latencySamples = 0;
+}
@@ -0,0 +1,76 @@
+#pragma once
+#include "camera.h"
+#include <QElapsedTimer>
+#include <QObject>
+#include <QPointF>
+
+class QOpenGLWidget;
+
+// Paces a QOpenGLWidget to the display. Input handlers add their deltas
+// here instead of changing the view, and paintGL takes everything that
+// arrived since the last frame in one go. A new frame is only requested
+// once the previous one was swapped, so at most one frame is in flight and
+// bursts of mouse or touchpad events become a single render per vsync.
+// Nothing is rendered while nothing changed.
+class FrameScheduler : public QObject {
+  Q_OBJECT
+
+public:
+  // Input accumulated between two frames
+  struct Input {
+    QPointF pan;             // Drag distance in widget pixels
+    double zoomFactor = 1.0; // Product of all wheel steps
+    QPointF zoomAnchor;      // Widget position of the latest wheel event
+    int events = 0;
+
+    bool isEmpty() const { return events == 0; }
+  };
+
+  static constexpr int statsInterval = 300; // Frames between log lines
+
+  explicit FrameScheduler(QOpenGLWidget *widget);
+
+  void addPan(const QPointF &pixels);
+  void addZoom(double factor, const QPointF &anchor);
+  void requestFrame(); // Something else changed (data, hover, overlay)
+
+  // From paintGL, once per frame
+  Input takeInput();
+
+  // Smoothed from recent input, zero once input stops
+  QPointF panVelocity() const; // Widget pixels per second
+  double zoomVelocity() const; // Doublings of zoom per second
+  // Where camera will be after `seconds` if the current motion continues
+  Camera predict(const Camera &camera, double seconds) const;
+
+private:
+  void frameSwapped();
+  void reportStats();
+  double vsyncMs() const;
+  double sinceLastInput(); // Seconds, restarts the clock
+
+  static constexpr double velocitySmoothing = 0.3; // Weight of a new sample
+  static constexpr qint64 velocityTimeoutMs = 150;
+
+  QOpenGLWidget *widget;
+  Input pending;
+  bool dirty = false;         // Requested since the last frame started
+  bool frameInFlight = false; // update() issued, not swapped yet
+  bool continuous = false;    // The last frame was requested before the
+                              // one before it swapped
+  QElapsedTimer requestTimer; // Since update() was issued
+  QElapsedTimer swapTimer;    // Since the last swap
+  QElapsedTimer inputTimer;   // Since the first input of the next frame
+  QElapsedTimer frameInput;   // inputTimer of the frame being rendered
+  QElapsedTimer velocityTimer; // Since the latest pan or zoom event
+  QPointF panSpeed;
+  double zoomSpeed = 0;
+
+  // Counters since the last report
+  int frames = 0;
+  int events = 0;
+  int late = 0;
+  int dropped = 0;
+  qint64 inputLatencyNanos = 0;
+  int latencySamples = 0;
+};
@@ -0,0 +1,682 @@
+#include "geometry_tiles.h"
+#include "map_style.h"
+#include <QColor>
+#include <QOpenGLContext>
+#include <QOpenGLFunctions>
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+
+namespace {
+
+// Map units to tile-local units of one tile, see TileVertex
+struct TileLocal {
+  explicit TileLocal(const QRectF &rect)
+      : origin(rect.topLeft()), scale(GeometryTiles::tileExtent / rect.width()) {}
+
+  quint16 x(const QPointF &pt) const { return local(pt.x() - origin.x()); }
+  quint16 y(const QPointF &pt) const { return local(pt.y() - origin.y()); }
+
+  // Clipped geometry stays inside the tile, clamping only catches rounding
+  quint16 local(double offset) const {
+    return quint16(std::clamp(std::lround(offset * scale), 0l,
+                              long(GeometryTiles::tileExtent)));
+  }
+
+  QPointF origin;
+  double scale;
+};
+
+TileVertex vertex(const TileLocal &local, const QPointF &pt,
+                  const QColor &color) {
+  // Alpha is left opaque, as the immediate-mode passes did
+  return {local.x(pt), local.y(pt), quint8(color.red()),
+          quint8(color.green()), quint8(color.blue()), 255};
+}
+
+RoadVertex roadVertex(const TileLocal &local, const QPointF &pt,
+                      const QPointF &extrude, qint8 edgeX, qint8 edgeY) {
+  auto normalized = [](double v) {
+    return qint16(std::lround(
+        std::clamp(v / GeometryTiles::extrudeRange, -1.0, 1.0) * 32767));
+  };
+  return {local.x(pt),
+          local.y(pt),
+          normalized(extrude.x()),
+          normalized(extrude.y()),
+          edgeX,
+          edgeY,
+          {0, 0}};
+}
+
+// Sutherland-Hodgman clip of a ring against an axis-aligned rectangle
+QVector<QPointF> clipPolygon(const QVector<QPointF> &ring, const QRectF &r) {
+  QVector<QPointF> out = ring;
+
+  auto clipEdge = [&](auto inside, auto intersect) {
+    QVector<QPointF> in;
+    in.swap(out);
+    for (int i = 0; i < in.size(); ++i) {
+      const QPointF &cur = in[i];
+      const QPointF &prev = in[(i + in.size() - 1) % in.size()];
+      bool curIn = inside(cur);
+      if (curIn != inside(prev))
+        out.append(intersect(prev, cur));
+      if (curIn)
+        out.append(cur);
+    }
+  };
+
+  auto atX = [](const QPointF &a, const QPointF &b, double x) {
+    double t = (x - a.x()) / (b.x() - a.x());
+    return QPointF(x, a.y() + (b.y() - a.y()) * t);
+  };
+  auto atY = [](const QPointF &a, const QPointF &b, double y) {
+    double t = (y - a.y()) / (b.y() - a.y());
+    return QPointF(a.x() + (b.x() - a.x()) * t, y);
+  };
+
+  clipEdge([&](const QPointF &p) { return p.x() >= r.left(); },
+           [&](const QPointF &a, const QPointF &b) { return atX(a, b, r.left()); });
+  clipEdge([&](const QPointF &p) { return p.x() <= r.right(); },
+           [&](const QPointF &a, const QPointF &b) { return atX(a, b, r.right()); });
+  clipEdge([&](const QPointF &p) { return p.y() >= r.top(); },
+           [&](const QPointF &a, const QPointF &b) { return atY(a, b, r.top()); });
+  clipEdge([&](const QPointF &p) { return p.y() <= r.bottom(); },
+           [&](const QPointF &a, const QPointF &b) { return atY(a, b, r.bottom()); });
+  return out;
+}
+
+// Liang-Barsky clip of segment a-b; false when it lies fully outside
+bool clipSegment(QPointF &a, QPointF &b, const QRectF &r) {
+  const double dx = b.x() - a.x();
+  const double dy = b.y() - a.y();
+  const double p[4] = {-dx, dx, -dy, dy};
+  const double q[4] = {a.x() - r.left(), r.right() - a.x(), a.y() - r.top(),
+                       r.bottom() - a.y()};
+  double t0 = 0.0, t1 = 1.0;
+
+  for (int k = 0; k < 4; ++k) {
+    if (p[k] == 0.0) {
+      if (q[k] < 0.0)
+        return false;
+      continue;
+    }
+    double t = q[k] / p[k];
+    if (p[k] < 0.0)
+      t0 = std::max(t0, t);
+    else
+      t1 = std::min(t1, t);
+  }
+  if (t0 > t1)
+    return false;
+
+  const QPointF start = a;
+  a = start + QPointF(dx, dy) * t0;
+  b = start + QPointF(dx, dy) * t1;
+  return true;
+}
+
+// Appends a polygon's cached triangles. Polygons inside the tile share their
+// vertices through the index buffer; ones crossing the border are clipped
+// triangle by triangle.
+void appendFill(TileGeometry &geo, const QVector<QPointF> &points,
+                const QVector<quint32> &triangles, const QRectF &rect,
+                const QColor &color) {
+  if (triangles.isEmpty())
+    return;
+  const TileLocal local(rect);
+
+  double minX = points[0].x(), maxX = minX;
+  double minY = points[0].y(), maxY = minY;
+  for (const QPointF &pt : points) {
+    minX = std::min(minX, pt.x());
+    maxX = std::max(maxX, pt.x());
+    minY = std::min(minY, pt.y());
+    maxY = std::max(maxY, pt.y());
+  }
+
+  if (minX >= rect.left() && maxX <= rect.right() && minY >= rect.top() &&
+      maxY <= rect.bottom()) {
+    const quint32 base = geo.fillVertices.size();
+    for (const QPointF &pt : points)
+      geo.fillVertices.append(vertex(local, pt, color));
+    for (quint32 index : triangles)
+      geo.fillIndices.append(base + index);
+    return;
+  }
+
+  for (int t = 0; t + 2 < triangles.size(); t += 3) {
+    QVector<QPointF> tri = {points[triangles[t]], points[triangles[t + 1]],
+                            points[triangles[t + 2]]};
+    QVector<QPointF> clipped = clipPolygon(tri, rect);
+    if (clipped.size() < 3)
+      continue;
+
+    // A clipped triangle is convex, so a fan covers it
+    const quint32 base = geo.fillVertices.size();
+    for (const QPointF &pt : clipped)
+      geo.fillVertices.append(vertex(local, pt, color));
+    for (int i = 1; i + 1 < clipped.size(); ++i) {
+      geo.fillIndices.append(base);
+      geo.fillIndices.append(base + i);
+      geo.fillIndices.append(base + i + 1);
+    }
+  }
+}
+
+// Corners sharper than this miter length get a round join instead
+constexpr double maxMiter = GeometryTiles::extrudeRange;
+
+QPointF segmentNormal(const QPointF &a, const QPointF &b) {
+  QPointF d = b - a;
+  double len = std::hypot(d.x(), d.y());
+  return len > 0 ? QPointF(-d.y() / len, d.x() / len) : QPointF();
+}
+
+// Round dot of the road's width, used for caps and sharp joins
+void appendDot(TileGeometry &geo, const TileLocal &local,
+               const QPointF &center) {
+  const quint32 base = geo.roadVertices.size();
+  const qint8 corners[4][2] = {{-1, -1}, {1, -1}, {1, 1}, {-1, 1}};
+  for (const auto &c : corners)
+    geo.roadVertices.append(
+        roadVertex(local, center, QPointF(c[0], c[1]), c[0], c[1]));
+  for (quint32 i : {0u, 1u, 2u, 0u, 2u, 3u})
+    geo.roadIndices.append(base + i);
+}
+
+// Extrudes a run of centerline points into a ribbon with miter joins
+void appendRibbon(TileGeometry &geo, const TileLocal &local,
+                  const QVector<QPointF> &run, bool capStart, bool capEnd) {
+  if (run.size() < 2)
+    return;
+
+  bool connected = false;
+  auto emitPair = [&](const QPointF &pt, const QPointF &extrude) {
+    const quint32 left = geo.roadVertices.size();
+    geo.roadVertices.append(roadVertex(local, pt, extrude, 1, 0));
+    geo.roadVertices.append(roadVertex(local, pt, -extrude, -1, 0));
+    if (connected) {
+      for (quint32 i : {left - 2, left - 1, left, left - 1, left + 1, left})
+        geo.roadIndices.append(i);
+    }
+    connected = true;
+  };
+
+  emitPair(run[0], segmentNormal(run[0], run[1]));
+  for (int i = 1; i + 1 < run.size(); ++i) {
+    QPointF in = segmentNormal(run[i - 1], run[i]);
+    QPointF out = segmentNormal(run[i], run[i + 1]);
+    QPointF miter = in + out;
+    double len = std::hypot(miter.x(), miter.y());
+    double cosHalf = len > 0 ? QPointF::dotProduct(miter / len, in) : 0.0;
+
+    if (cosHalf > 1.0 / maxMiter) {
+      emitPair(run[i], miter / (len * cosHalf));
+    } else {
+      emitPair(run[i], in);
+      connected = false;
+      emitPair(run[i], out);
+      appendDot(geo, local, run[i]);
+    }
+  }
+  emitPair(run.last(), segmentNormal(run[run.size() - 2], run.last()));
+
+  if (capStart)
+    appendDot(geo, local, run.first());
+  if (capEnd)
+    appendDot(geo, local, run.last());
+}
+
+// Clips a road to the tile and extrudes each continuous in-tile run. Only
+// the road's real ends get caps, cuts at the tile border stay flat so they
+// meet the neighbouring tile's ribbon.
+void appendRoad(TileGeometry &geo, const QVector<QPointF> &nodes,
+                const QRectF &rect) {
+  const TileLocal local(rect);
+  QVector<QPointF> run;
+  bool capStart = false;
+
+  for (int i = 1; i < nodes.size(); ++i) {
+    QPointF a = nodes[i - 1];
+    QPointF b = nodes[i];
+    if (!clipSegment(a, b, rect)) {
+      appendRibbon(geo, local, run, capStart, false);
+      run.clear();
+      continue;
+    }
+    if (run.isEmpty() || run.last() != a) {
+      appendRibbon(geo, local, run, capStart, false);
+      run = {a};
+      capStart = i == 1 && a == nodes.first();
+    }
+    if (b != run.last())
+      run.append(b);
+  }
+  appendRibbon(geo, local, run, capStart,
+               !run.isEmpty() && run.last() == nodes.last());
+}
+
+void appendArea(TileGeometry &geo, const PolygonArea &area, int lod,
+                const QRectF &rect, const QColor &color) {
+  if (lod >= 0 && lod < area.lods.size()) {
+    const AreaLod &level = area.lods[lod];
+    appendFill(geo, level.vertices, level.triangles, rect, color);
+  } else {
+    appendFill(geo, area.vertices(), area.triangles, rect, color);
+  }
+}
+
+} // namespace
+
+GeometryTiles::GeometryTiles(const Graph &g) : graph(g) {}
+
+GeometryTiles::~GeometryTiles() { clear(); }
+
+void GeometryTiles::invalidate() { stale = true; }
+
+void GeometryTiles::clear() {
+  waitForPrefetch();
+  for (GeometryTile *tile : tiles)
+    destroyTile(tile);
+  tiles.clear();
+  visible.clear();
+  gpuUsed = 0;
+  prefetchedBytes = 0;
+}
+
+void GeometryTiles::invalidate(const QRectF &changed) {
+  if (stale)
+    return;
+  // Tile keys only hold while the root still covers everything
+  if (!root.contains(graphBounds())) {
+    stale = true;
+    return;
+  }
+
+  waitForPrefetch(); // Builds may have read the old features
+  // Inclusive, unlike QRectF::intersects: a single straight road changes an
+  // area of zero width or height
+  for (GeometryTile *tile : tiles) {
+    if (tile->rect.left() <= changed.right() &&
+        changed.left() <= tile->rect.right() &&
+        tile->rect.top() <= changed.bottom() &&
+        changed.top() <= tile->rect.bottom())
+      tile->dirty = true;
+  }
+}
+
+QRectF GeometryTiles::graphBounds() const {
+  return graph.buildingIndex.bounds()
+      .united(graph.polygonIndex.bounds())
+      .united(graph.roadIndex.bounds());
+}
+
+void GeometryTiles::updateRoot() {
+  QRectF bounds = graphBounds();
+  double side = std::max(bounds.width(), bounds.height());
+  root = bounds.isNull() ? QRectF()
+                         : QRectF(bounds.topLeft(), QSizeF(side, side));
+}
+
+int GeometryTiles::levelForZoom(float zoom) const {
+  if (root.isEmpty())
+    return 0;
+  double level = std::ceil(std::log2(zoom * root.width() / tileScreenSize));
+  return std::clamp(int(level), 0, maxLevel);
+}
+
+QRectF GeometryTiles::tileRect(const TileKey &key) const {
+  double size = root.width() / double(1 << key.level);
+  return QRectF(root.left() + key.x * size, root.top() + key.y * size, size,
+                size);
+}
+
+QVector<TileKey> GeometryTiles::keysCovering(const QRectF &viewRect,
+                                             int level) const {
+  QVector<TileKey> keys;
+  if (root.isEmpty() || viewRect.right() < root.left() ||
+      viewRect.left() > root.right() || viewRect.bottom() < root.top() ||
+      viewRect.top() > root.bottom())
+    return keys;
+
+  const int count = 1 << level;
+  const double size = root.width() / count;
+  auto cell = [&](double v, double origin) {
+    return std::clamp(int(std::floor((v - origin) / size)), 0, count - 1);
+  };
+
+  int x0 = cell(viewRect.left(), root.left());
+  int x1 = cell(viewRect.right(), root.left());
+  int y0 = cell(viewRect.top(), root.top());
+  int y1 = cell(viewRect.bottom(), root.top());
+  for (int y = y0; y <= y1; ++y) {
+    for (int x = x0; x <= x1; ++x)
+      keys.append({level, x, y});
+  }
+  return keys;
+}
+
+const QVector<GeometryTile *> &
+GeometryTiles::visibleTiles(const QRectF &viewRect, float zoom) {
+  if (stale) {
+    clear();
+    updateRoot();
+    stale = false;
+  }
+
+  ++frame;
+  visible.clear();
+
+  for (const TileKey &key : keysCovering(viewRect, levelForZoom(zoom))) {
+    GeometryTile *tile = tiles.value(key, nullptr);
+    if (!tile) {
+      // Built in the background already: only the upload is left
+      auto job = building.find(key);
+      if (job != building.end()) {
+        TileGeometry geo = job.value().get();
+        building.erase(job);
+        tile = uploadTile(key, geo);
+        ++stats.hits;
+      } else {
+        tile = createTile(key);
+        ++stats.misses;
+      }
+      tiles.insert(key, tile);
+    } else if (tile->prefetched) {
+      tile->prefetched = false;
+      prefetchedBytes -= tile->gpuBytes;
+      ++stats.hits;
+    }
+    if (tile->dirty)
+      fillTile(tile, buildTile(graph, key, tile->rect, root.width()));
+    tile->lastUsed = frame;
+    visible.append(tile);
+  }
+
+  evict();
+  return visible;
+}
+
+void GeometryTiles::prefetch(const QRectF &viewRect, float zoom) {
+  if (stale || root.isEmpty())
+    return;
+
+  // Step 1: Upload finished builds while the speculative budget holds
+  int uploads = 0;
+  for (auto it = building.begin(); it != building.end();) {
+    if (uploads == maxPrefetchUploads ||
+        it.value().wait_for(std::chrono::seconds(0)) !=
+            std::future_status::ready) {
+      ++it;
+      continue;
+    }
+
+    const TileKey key = it.key();
+    TileGeometry geo = it.value().get();
+    it = building.erase(it);
+    if (prefetchedBytes >= prefetchBudget) {
+      ++stats.wasted;
+      continue;
+    }
+
+    GeometryTile *tile = uploadTile(key, geo);
+    tile->prefetched = true;
+    tile->lastUsed = frame;
+    prefetchedBytes += tile->gpuBytes;
+    tiles.insert(key, tile);
+    ++uploads;
+  }
+
+  // Step 2: Build missing tiles of the predicted view in the background
+  for (const TileKey &key : keysCovering(viewRect, levelForZoom(zoom))) {
+    if (building.size() >= maxPrefetchJobs)
+      break;
+    if (tiles.contains(key) || building.contains(key))
+      continue;
+    building.insert(key, std::async(std::launch::async, &GeometryTiles::buildTile,
+                                    std::cref(graph), key, tileRect(key),
+                                    root.width())
+                             .share());
+  }
+}
+
+void GeometryTiles::waitForPrefetch() {
+  for (const auto &job : building)
+    job.wait();
+  building.clear();
+}
+
+TileGeometry GeometryTiles::buildGeometry(const Graph &graph,
+                                          const QRectF &rect, int lod,
+                                          float minZoom, float maxZoom) {
+  TileGeometry geo;
+  QVector<int> hits;
+
+  // Every class gets a range, even when empty or hidden at this tile's zoom
+  // range, so all tiles share the same range layout
+  auto beginRange = [&](FeatureClass cls) {
+    FillRange range;
+    range.first = geo.fillIndices.size();
+    range.cls = cls;
+    return range;
+  };
+  auto endRange = [&](FillRange &range) {
+    range.count = geo.fillIndices.size() - range.first;
+    geo.fillRanges.append(range);
+  };
+
+  // Step 1: Buildings, then landuse fills by class
+  FillRange buildings = beginRange(FeatureClass::Building);
+  if (isVisibleBetween(FeatureClass::Building, minZoom, maxZoom)) {
+    graph.buildingIndex.query(rect, hits);
+    std::sort(hits.begin(), hits.end());
+    const QColor color = areaColor(FeatureClass::Building);
+    for (int i : hits)
+      appendArea(geo, graph.buildings[i], lod, rect, color);
+  }
+  endRange(buildings);
+
+  // Polygons and roads are stored grouped by class (Graph::classifyFeatures),
+  // so sorted hits run through the classes in drawing order
+  hits.clear();
+  graph.polygonIndex.query(rect, hits);
+  std::sort(hits.begin(), hits.end());
+  int h = 0;
+  for (int c = 0; c < areaClassCount; ++c) {
+    const FeatureClass cls = FeatureClass(firstAreaClass + c);
+    const int end = graph.areaClassStart[c + 1];
+    const bool visible = isVisibleBetween(cls, minZoom, maxZoom);
+    const QColor color = areaColor(cls);
+
+    FillRange range = beginRange(cls);
+    for (; h < hits.size() && hits[h] < end; ++h) {
+      if (visible)
+        appendArea(geo, graph.polygons[hits[h]], lod, rect, color);
+    }
+    endRange(range);
+  }
+
+  // Step 2: Road meshes, one range per road class
+  hits.clear();
+  graph.roadIndex.query(rect, hits);
+  std::sort(hits.begin(), hits.end());
+  h = 0;
+  for (int c = 0; c < roadClassCount; ++c) {
+    const FeatureClass cls = FeatureClass(c);
+    const int end = graph.roadClassStart[c + 1];
+    const bool visible = isVisibleBetween(cls, minZoom, maxZoom);
+
+    RoadRange range;
+    range.first = geo.roadIndices.size();
+    range.cls = cls;
+    for (; h < hits.size() && hits[h] < end; ++h) {
+      const Road &road = graph.roads[hits[h]];
+      if (visible && road.nodes.size() >= 2)
+        appendRoad(geo, road.nodesAt(lod), rect);
+    }
+    range.count = geo.roadIndices.size() - range.first;
+    geo.roadRanges.append(range);
+  }
+
+  return geo;
+}
+
+TileGeometry GeometryTiles::buildTile(const Graph &graph, TileKey key,
+                                      QRectF rect, double rootWidth) {
+  // Zoomed-out levels draw the matching simplified geometry
+  int lod = key.level < Graph::lodLevels ? key.level : -1;
+  // Zoom range served by this level, see levelForZoom
+  float minZoom = key.level == 0
+                      ? 0.0f
+                      : tileScreenSize * float(1 << (key.level - 1)) / rootWidth;
+  float maxZoom = key.level == maxLevel
+                      ? std::numeric_limits<float>::max()
+                      : tileScreenSize * float(1 << key.level) / rootWidth;
+  return buildGeometry(graph, rect, lod, minZoom, maxZoom);
+}
+
+GeometryTile *GeometryTiles::createTile(const TileKey &key) {
+  return uploadTile(key, buildTile(graph, key, tileRect(key), root.width()));
+}
+
+GeometryTile *GeometryTiles::uploadTile(const TileKey &key,
+                                        const TileGeometry &geo) {
+  GeometryTile *tile = new GeometryTile;
+  tile->key = key;
+  tile->rect = tileRect(key);
+  fillTile(tile, geo);
+  return tile;
+}
+
+// Writes geo into the tile's buffers, creating them on first use. Fresh
+// storage can't be in use and is filled directly. A rewrite of a tile the GPU
+// may still be drawing from goes through the staging ring, copied on the GPU
+// in command order instead of waiting in glBufferSubData.
+void GeometryTiles::fillTile(GeometryTile *tile, const TileGeometry &geo) {
+  tile->fillRanges = geo.fillRanges;
+  tile->roadRanges = geo.roadRanges;
+  tile->dirty = false;
+  gpuUsed -= tile->gpuBytes;
+
+  auto store = [&](QOpenGLBuffer &buffer, int &capacity, const void *data,
+                   int bytes) {
+    if (capacity == 0) {
+      buffer.allocate(data, bytes);
+      capacity = bytes;
+    } else if (bytes > capacity) {
+      // New storage; the old one is released once the GPU is done with it
+      capacity = bytes + bytes / 100 * growthPercent;
+      buffer.allocate(capacity);
+      buffer.write(0, data, bytes);
+    } else if (uploads && uploads->upload(buffer.bufferId(), 0, data, bytes)) {
+      return;
+    } else {
+      buffer.write(0, data, bytes); // No ring, may wait for the GPU
+    }
+    if (uploads)
+      uploads->countUpload(bytes);
+  };
+
+  auto upload = [&](QOpenGLBuffer &buffer, int &bufferBytes,
+                    QOpenGLBuffer &indexBuffer, int &indexBytes,
+                    QOpenGLVertexArrayObject &vao, const auto &vertices,
+                    const QVector<quint32> &indices, void (*setupAttributes)()) {
+    if (indices.isEmpty())
+      return; // Ranges are all empty, whatever the buffers still hold
+
+    // The VAO captures the buffer bindings and attribute layout once
+    const bool fresh = !buffer.isCreated();
+    if (fresh) {
+      vao.create();
+      buffer.create();
+      indexBuffer.create();
+    }
+    if (vao.isCreated())
+      vao.bind();
+    buffer.bind();
+    store(buffer, bufferBytes, vertices.constData(),
+          int(vertices.size() * sizeof(vertices[0])));
+    indexBuffer.bind();
+    store(indexBuffer, indexBytes, indices.constData(),
+          int(indices.size() * sizeof(quint32)));
+    if (vao.isCreated()) {
+      if (fresh)
+        setupAttributes();
+      vao.release();
+    }
+    buffer.release();
+    indexBuffer.release();
+  };
+  upload(tile->fillBuffer, tile->fillBytes, tile->fillIndexBuffer,
+         tile->fillIndexBytes, tile->fillVao, geo.fillVertices,
+         geo.fillIndices, &setupVertexAttributes);
+  upload(tile->roadBuffer, tile->roadBytes, tile->roadIndexBuffer,
+         tile->roadIndexBytes, tile->roadVao, geo.roadVertices,
+         geo.roadIndices, &setupRoadAttributes);
+
+  tile->gpuBytes = qint64(tile->fillBytes) + tile->fillIndexBytes +
+                   tile->roadBytes + tile->roadIndexBytes;
+  gpuUsed += tile->gpuBytes;
+}
+
+void GeometryTiles::setupVertexAttributes() {
+  QOpenGLFunctions *gl = QOpenGLContext::currentContext()->functions();
+  gl->glEnableVertexAttribArray(positionAttribute);
+  gl->glEnableVertexAttribArray(colorAttribute);
+  gl->glVertexAttribPointer(positionAttribute, 2, GL_UNSIGNED_SHORT, GL_FALSE,
+                            sizeof(TileVertex), nullptr);
+  gl->glVertexAttribPointer(
+      colorAttribute, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(TileVertex),
+      reinterpret_cast<const void *>(offsetof(TileVertex, r)));
+}
+
+void GeometryTiles::setupRoadAttributes() {
+  QOpenGLFunctions *gl = QOpenGLContext::currentContext()->functions();
+  gl->glEnableVertexAttribArray(positionAttribute);
+  gl->glEnableVertexAttribArray(extrudeAttribute);
+  gl->glEnableVertexAttribArray(edgeAttribute);
+  gl->glVertexAttribPointer(positionAttribute, 2, GL_UNSIGNED_SHORT, GL_FALSE,
+                            sizeof(RoadVertex), nullptr);
+  gl->glVertexAttribPointer(
+      extrudeAttribute, 2, GL_SHORT, GL_TRUE, sizeof(RoadVertex),
+      reinterpret_cast<const void *>(offsetof(RoadVertex, extrudeX)));
+  gl->glVertexAttribPointer(
+      edgeAttribute, 2, GL_BYTE, GL_TRUE, sizeof(RoadVertex),
+      reinterpret_cast<const void *>(offsetof(RoadVertex, edgeX)));
+}
+
+void GeometryTiles::destroyTile(GeometryTile *tile) {
+  tile->fillVao.destroy();
+  tile->roadVao.destroy();
+  tile->fillBuffer.destroy();
+  tile->fillIndexBuffer.destroy();
+  tile->roadBuffer.destroy();
+  tile->roadIndexBuffer.destroy();
+  gpuUsed -= tile->gpuBytes;
+  delete tile;
+}
+
+// Drops least-recently-used tiles until the budget holds. Tiles used in the
+// current frame are never evicted, even when they alone exceed the budget.
+void GeometryTiles::evict() {
+  while (gpuUsed > gpuBudget) {
+    GeometryTile *oldest = nullptr;
+    for (GeometryTile *tile : tiles) {
+      if (tile->lastUsed != frame &&
+          (!oldest || tile->lastUsed < oldest->lastUsed))
+        oldest = tile;
+    }
+    if (!oldest)
+      break;
+
+    if (oldest->prefetched) {
+      prefetchedBytes -= oldest->gpuBytes;
+      ++stats.wasted;
+    }
+    tiles.remove(oldest->key);
+    destroyTile(oldest);
+  }
+}
@@ -0,0 +1,201 @@
+#pragma once
+#include "feature_rules.h"
+#include "graph.h"
+#include "streaming_buffer.h"
+#include <QHash>
+#include <QOpenGLBuffer>
+#include <QOpenGLVertexArrayObject>
+#include <QRectF>
+#include <QVector>
+#include <future>
+
+// Address of a quadtree tile. Level 0 is one tile covering the whole map,
+// every level below splits each tile into four.
+struct TileKey {
+  int level = 0;
+  int x = 0;
+  int y = 0;
+
+  bool operator==(const TileKey &o) const {
+    return level == o.level && x == o.x && y == o.y;
+  }
+};
+
+inline size_t qHash(const TileKey &key, size_t seed = 0) {
+  return qHashMulti(seed, key.level, key.x, key.y);
+}
+
+// Vertex positions are tile-local, 0 to GeometryTiles::tileExtent across the
+// tile from its top-left corner, so every tile keeps the same precision at
+// any zoom and a position takes 4 bytes instead of 8.
+struct TileVertex {
+  quint16 x, y;
+  quint8 r, g, b, a;
+};
+
+// Road centerline vertex, pushed out by the shader to the style's width in
+// pixels. edge is (+-1, 0) across a ribbon and (+-1, +-1) on the corners of
+// the round joins and caps, so length(edge) is the distance to the centerline.
+struct RoadVertex {
+  quint16 x, y;
+  qint16 extrudeX, extrudeY; // Direction scaled for miter joins, normalized
+                             // to GeometryTiles::extrudeRange
+  qint8 edgeX, edgeY;
+  qint8 padding[2]; // Keeps the stride a multiple of 4
+};
+
+// Indexed fill triangles of one feature class
+struct FillRange {
+  int first = 0; // Index offset
+  int count = 0;
+  FeatureClass cls = FeatureClass::Building;
+};
+
+// Indexed road triangles of one style class (see roadStyle), casing and
+// fill in one pass
+struct RoadRange {
+  int first = 0; // Index offset
+  int count = 0;
+  FeatureClass cls = FeatureClass::Footway;
+};
+
+// Clipped, pre-processed vertex data of one tile, built on the CPU
+struct TileGeometry {
+  QVector<TileVertex> fillVertices;
+  QVector<quint32> fillIndices; // GL_TRIANGLES, buildings then areas
+  QVector<FillRange> fillRanges;
+  QVector<RoadVertex> roadVertices;
+  QVector<quint32> roadIndices; // GL_TRIANGLES in road layer order
+  QVector<RoadRange> roadRanges;
+};
+
+// One tile resident on the GPU
+struct GeometryTile {
+  TileKey key;
+  QRectF rect; // Map units covered, the origin of its vertex positions
+  QOpenGLBuffer fillBuffer{QOpenGLBuffer::VertexBuffer};
+  QOpenGLBuffer fillIndexBuffer{QOpenGLBuffer::IndexBuffer};
+  QOpenGLBuffer roadBuffer{QOpenGLBuffer::VertexBuffer};
+  QOpenGLBuffer roadIndexBuffer{QOpenGLBuffer::IndexBuffer};
+  QOpenGLVertexArrayObject fillVao; // Not created when VAOs are unsupported
+  QOpenGLVertexArrayObject roadVao;
+  QVector<FillRange> fillRanges;
+  QVector<RoadRange> roadRanges;
+  // Allocated bytes of the buffers, at least what they hold
+  int fillBytes = 0;
+  int fillIndexBytes = 0;
+  int roadBytes = 0;
+  int roadIndexBytes = 0;
+  qint64 gpuBytes = 0;
+  quint64 lastUsed = 0;
+  bool prefetched = false; // Uploaded ahead of time, not drawn yet
+  bool dirty = false;      // Graph changed here, refill before drawing
+};
+
+// Quadtree of geometry tiles over Graph. Tiles are built the first time they
+// are visible and evicted least-recently-used once the GPU budget is used up.
+// Tiles of a predicted view can be built on background threads and uploaded
+// ahead of time (prefetch). All methods except buildGeometry and
+// waitForPrefetch need the GL context to be current.
+class GeometryTiles {
+public:
+  static constexpr int maxLevel = 12;
+  static constexpr int tileScreenSize = 512; // Target on-screen tile size (px)
+  // Tile-local units across a tile: 1/16 px or finer for tiles drawn up to
+  // twice tileScreenSize
+  static constexpr int tileExtent = 16384;
+  static constexpr float extrudeRange = 2.0f; // Longest miter, see appendRibbon
+
+  // Shader attribute locations of the TileVertex and RoadVertex layouts
+  static constexpr int positionAttribute = 0;
+  static constexpr int colorAttribute = 1;
+  static constexpr int extrudeAttribute = 1;
+  static constexpr int edgeAttribute = 2;
+  // Point the attributes at the currently bound vertex buffer
+  static void setupVertexAttributes();
+  static void setupRoadAttributes();
+
+  explicit GeometryTiles(const Graph &graph);
+  ~GeometryTiles();
+
+  void invalidate(); // Graph geometry changed, rebuild tiles on next use
+  // Only features inside changed were added or edited. Tiles overlapping it
+  // are rebuilt when next used and rewritten in their existing buffers;
+  // every other tile is kept as it is. Only sets flags, no GL needed.
+  void invalidate(const QRectF &changed);
+  void clear();      // Frees every tile
+
+  // Rewrites of buffers the GPU may still draw from go through this ring
+  // when it is available (not owned)
+  void setUploadBuffer(StreamingBuffer *buffer) { uploads = buffer; }
+  // Spare room given to a rewritten buffer that outgrew its storage, so
+  // further edits of the tile fit in place
+  static constexpr int growthPercent = 50;
+
+  void setGpuBudget(qint64 bytes) { gpuBudget = bytes; }
+  qint64 gpuBudgetBytes() const { return gpuBudget; }
+  qint64 gpuBytes() const { return gpuUsed; }
+  int tileCount() const { return tiles.size(); }
+
+  int levelForZoom(float zoom) const;
+  QRectF tileRect(const TileKey &key) const;
+
+  // Tiles covering viewRect at the level matching zoom, creating missing ones
+  const QVector<GeometryTile *> &visibleTiles(const QRectF &viewRect,
+                                              float zoom);
+
+  // Starts background builds for the tiles of a predicted view and uploads
+  // finished ones, a few per call. Speculative tiles stay within the
+  // prefetch budget. Call once per frame after visibleTiles.
+  void prefetch(const QRectF &viewRect, float zoom);
+  void waitForPrefetch(); // Background builds read Graph, call before it changes
+  void setPrefetchBudget(qint64 bytes) { prefetchBudget = bytes; }
+
+  static constexpr int maxPrefetchJobs = 4;
+  static constexpr int maxPrefetchUploads = 2; // Per frame
+
+  // Visible tiles that had to be built on the spot (misses) vs. ones built
+  // or uploaded ahead of time (hits). Wasted: prefetched, never drawn.
+  struct PrefetchStats {
+    qint64 hits = 0;
+    qint64 misses = 0;
+    qint64 wasted = 0;
+  };
+  const PrefetchStats &prefetchStats() const { return stats; }
+
+  // Vertices are relative to rect (see TileVertex). lod picks a simplified
+  // level of Graph, -1 for the full geometry. Feature classes hidden across
+  // [minZoom, maxZoom] are left out.
+  static TileGeometry buildGeometry(const Graph &graph, const QRectF &rect,
+                                    int lod = -1, float minZoom = 0.0f,
+                                    float maxZoom = 1e9f);
+
+private:
+  // CPU half of a tile: clipped geometry at the level's simplification.
+  // Only reads graph, so it runs on prefetch threads too.
+  static TileGeometry buildTile(const Graph &graph, TileKey key, QRectF rect,
+                                double rootWidth);
+  GeometryTile *uploadTile(const TileKey &key, const TileGeometry &geo);
+  void fillTile(GeometryTile *tile, const TileGeometry &geo);
+  QVector<TileKey> keysCovering(const QRectF &viewRect, int level) const;
+  QRectF graphBounds() const;
+  void updateRoot();
+  GeometryTile *createTile(const TileKey &key);
+  void destroyTile(GeometryTile *tile);
+  void evict();
+
+  const Graph &graph;
+  StreamingBuffer *uploads = nullptr;
+  QHash<TileKey, GeometryTile *> tiles;
+  QVector<GeometryTile *> visible;
+  QRectF root; // Square covering all geometry
+  bool stale = true;
+  qint64 gpuBudget = 256ll * 1024 * 1024;
+  qint64 gpuUsed = 0;
+  quint64 frame = 0;
+
+  QHash<TileKey, std::shared_future<TileGeometry>> building; // Prefetch jobs
+  qint64 prefetchBudget = 32ll * 1024 * 1024;
+  qint64 prefetchedBytes = 0; // Prefetched tiles not drawn yet
+  PrefetchStats stats;
+};
@@ -0,0 +1,151 @@
+#include "glyph_atlas.h"
+#include <QFontMetricsF>
+#include <QPainter>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace {
+
+constexpr double inf = 1e20;
+
+// Felzenszwalb-Huttenlocher 1D squared distance transform of f into d
+void distanceTransform1D(const double *f, double *d, int n, std::vector<int> &v,
+                         std::vector<double> &z) {
+  int k = 0;
+  v[0] = 0;
+  z[0] = -inf;
+  z[1] = inf;
+  for (int q = 1; q < n; ++q) {
+    double s;
+    while (true) {
+      const int r = v[k];
+      s = ((f[q] + double(q) * q) - (f[r] + double(r) * r)) / (2.0 * (q - r));
+      if (s > z[k] || k == 0)
+        break;
+      --k;
+    }
+    ++k;
+    v[k] = q;
+    z[k] = s;
+    z[k + 1] = inf;
+  }
+
+  k = 0;
+  for (int q = 0; q < n; ++q) {
+    while (z[k + 1] < q)
+      ++k;
+    d[q] = double(q - v[k]) * (q - v[k]) + f[v[k]];
+  }
+}
+
+// Squared distance from every pixel to the nearest pixel where grid is 0
+void distanceTransform2D(std::vector<double> &grid, int w, int h) {
+  const int n = std::max(w, h);
+  std::vector<double> f(n), d(n), z(n + 1);
+  std::vector<int> v(n);
+
+  for (int x = 0; x < w; ++x) {
+    for (int y = 0; y < h; ++y)
+      f[y] = grid[y * w + x];
+    distanceTransform1D(f.data(), d.data(), h, v, z);
+    for (int y = 0; y < h; ++y)
+      grid[y * w + x] = d[y];
+  }
+  for (int y = 0; y < h; ++y) {
+    distanceTransform1D(&grid[y * w], d.data(), w, v, z);
+    std::copy(d.begin(), d.begin() + w, grid.begin() + y * w);
+  }
+}
+
+} // namespace
+
+GlyphAtlas::GlyphAtlas() : atlas(1024, 512, QImage::Format_RGBA8888) {
+  font.setPixelSize(fontPixelSize);
+  atlas.fill(Qt::transparent);
+}
+
+QRect GlyphAtlas::allocate(int w, int h) {
+  if (shelfX + w > atlas.width()) {
+    shelfY += shelfHeight;
+    shelfX = 0;
+    shelfHeight = 0;
+  }
+  if (shelfY + h > atlas.height()) {
+    if (atlas.height() * 2 > maxHeight)
+      return QRect(); // Full, glyph is skipped
+    // Grow downwards, glyphs already placed keep their pixel rects
+    QImage grown(atlas.width(), atlas.height() * 2, QImage::Format_RGBA8888);
+    grown.fill(Qt::transparent);
+    QPainter painter(&grown);
+    painter.setCompositionMode(QPainter::CompositionMode_Source);
+    painter.drawImage(QPointF(0, 0), atlas);
+    painter.end();
+    atlas = grown;
+  }
+
+  QRect rect(shelfX, shelfY, w, h);
+  shelfX += w;
+  shelfHeight = std::max(shelfHeight, h);
+  return rect;
+}
+
+Glyph GlyphAtlas::glyph(QChar ch) {
+  auto it = glyphs.constFind(ch);
+  if (it != glyphs.constEnd())
+    return it.value();
+
+  QFontMetricsF fm(font);
+  Glyph glyph;
+  glyph.advance = fm.horizontalAdvance(ch);
+
+  QRectF box = fm.boundingRect(ch);
+  if (box.isEmpty()) // Spaces only advance
+    return glyphs.insert(ch, glyph).value();
+
+  const int w = int(std::ceil(box.width())) + 2 * spread;
+  const int h = int(std::ceil(box.height())) + 2 * spread;
+  glyph.quad = QRectF(std::floor(box.left()) - spread,
+                      std::floor(box.top()) - spread, w, h);
+  glyph.texRect = allocate(w, h);
+  if (glyph.texRect.isNull())
+    return glyphs.insert(ch, glyph).value();
+
+  // Step 1: Rasterize the coverage mask
+  QImage mask(w, h, QImage::Format_ARGB32_Premultiplied);
+  mask.fill(Qt::transparent);
+  QPainter painter(&mask);
+  painter.setFont(font);
+  painter.setPen(Qt::white);
+  painter.drawText(QPointF(-glyph.quad.left(), -glyph.quad.top()),
+                   QString(ch));
+  painter.end();
+
+  // Step 2: Distances to the nearest inside and outside pixel
+  std::vector<double> outside(w * h), inside(w * h);
+  for (int y = 0; y < h; ++y) {
+    const QRgb *line = reinterpret_cast<const QRgb *>(mask.constScanLine(y));
+    for (int x = 0; x < w; ++x) {
+      const bool in = qAlpha(line[x]) > 127;
+      outside[y * w + x] = in ? 0.0 : inf;
+      inside[y * w + x] = in ? inf : 0.0;
+    }
+  }
+  distanceTransform2D(outside, w, h);
+  distanceTransform2D(inside, w, h);
+
+  // Step 3: Map the signed distance to 0..255 around 0.5 at the edge
+  for (int y = 0; y < h; ++y) {
+    uchar *out = atlas.scanLine(glyph.texRect.y() + y) + glyph.texRect.x() * 4;
+    for (int x = 0; x < w; ++x) {
+      const double dist =
+          std::sqrt(outside[y * w + x]) - std::sqrt(inside[y * w + x]);
+      const double value = std::clamp(0.5 - dist / (2.0 * spread), 0.0, 1.0);
+      const uchar v = uchar(std::lround(value * 255.0));
+      out[x * 4] = out[x * 4 + 1] = out[x * 4 + 2] = out[x * 4 + 3] = v;
+    }
+  }
+
+  dirty = true;
+  return glyphs.insert(ch, glyph).value();
+}
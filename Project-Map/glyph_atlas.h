@@ -0,0 +1,49 @@
+#pragma once
+#include <QChar>
+#include <QFont>
+#include <QHash>
+#include <QImage>
+#include <QRect>
+#include <QRectF>
+
+// One glyph of the atlas. Metrics are in atlas pixels relative to the pen
+// position on the baseline, y pointing down.
+struct Glyph {
+  QRectF quad;    // Glyph box including the distance field padding
+  QRect texRect;  // Where the glyph's distance field sits in the atlas
+  float advance = 0.0f;
+};
+
+// Signed-distance-field glyph atlas. Glyphs are rasterized with QPainter the
+// first time they are asked for, turned into a distance field and
+// shelf-packed into one image, so text of any size and rotation samples the
+// same texels.
+class GlyphAtlas {
+public:
+  static constexpr int fontPixelSize = 32;
+  static constexpr int spread = 4; // Distance field range around edges (px)
+  static constexpr int maxHeight = 4096;
+
+  GlyphAtlas();
+
+  Glyph glyph(QChar ch); // Adds missing glyphs to the atlas
+  float advance(QChar ch) { return glyph(ch).advance; }
+  // Snapshot of the glyphs added so far, safe to read from other threads
+  QHash<QChar, Glyph> glyphTable() const { return glyphs; }
+
+  // RGBA8888, distance in every channel. 0.5 is the glyph edge.
+  const QImage &image() const { return atlas; }
+  bool isDirty() const { return dirty; } // Changed since markClean
+  void markClean() { dirty = false; }
+
+private:
+  QRect allocate(int w, int h);
+
+  QFont font;
+  QImage atlas;
+  QHash<QChar, Glyph> glyphs;
+  int shelfX = 0;
+  int shelfY = 0;
+  int shelfHeight = 0;
+  bool dirty = true;
+};
@@ -1,4 +1,14 @@
 #include "graph.h"
+#include "simplifier.h"
+#include "triangulator.h"
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QMultiHash>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
 
 // QPointF Graph::normalizeLatLon(double lat, double lon) {
 //   double x = (lon - minLon) * scale;
@@ -36,40 +46,636 @@ void Graph::normalizeCoordinates() {
   centerX = ((maxLon - minLon) * scale) / 2.0;
   centerY = ((maxLat - minLat) * scale) / 2.0;
 
-  // Step 3: Normalize all building points
-  for (auto &poly : buildings) {
-    for (auto &pt : poly.nodes) {
-      double normX = (pt.x() - minLon) * scale;
-      double normY = (maxLat - pt.y()) * (-scale); // Y flipped (top-down)
-      pt.setX(normX);
-      pt.setY(normY);
+  // Step 3: Normalize all points
+  normalizeAppended(FeatureCounts());
+}
+
+Graph::FeatureCounts Graph::featureCounts() const {
+  return {int(buildings.size()), int(polygons.size()), int(roads.size()),
+          int(edges.size())};
+}
+
+QRectF Graph::normalizeAppended(const FeatureCounts &since) {
+  QRectF area;
+  auto normalize = [&](QPointF &pt) {
+    double normX = (pt.x() - minLon) * scale;
+    double normY = (maxLat - pt.y()) * (-scale); // Y flipped (top-down)
+    pt.setX(normX);
+    pt.setY(normY);
+  };
+  auto normalizeAreas = [&](auto &areas, int first) {
+    for (int i = first; i < areas.size(); ++i) {
+      PolygonArea &poly = areas[i];
+      for (auto &pt : poly.nodes)
+        normalize(pt);
+      for (auto &hole : poly.holes) {
+        for (auto &pt : hole)
+          normalize(pt);
+      }
+      area = area.united(boundsOf(poly.nodes));
     }
+  };
+  normalizeAreas(buildings, since.buildings);
+  normalizeAreas(polygons, since.polygons);
+
+  for (int i = since.roads; i < roads.size(); ++i) {
+    for (auto &pt : roads[i].nodes)
+      normalize(pt);
+    area = area.united(boundsOf(roads[i].nodes));
+  }
+
+  for (int i = since.edges; i < edges.size(); ++i) {
+    for (auto &pt : edges[i].geometry)
+      normalize(pt);
   }
+  return area;
+}
+
+// Appends `other` to the end of `road`. `other` must start or end at the last
+// node of `road`; it is reversed when needed so the polyline stays continuous.
+static void appendRoad(Road &road, Road other) {
+  if (other.nodeIds.first() != road.nodeIds.last()) {
+    std::reverse(other.nodes.begin(), other.nodes.end());
+    std::reverse(other.nodeIds.begin(), other.nodeIds.end());
+  }
+  for (int i = 1; i < other.nodes.size(); ++i) {
+    road.nodes.append(other.nodes[i]);
+    road.nodeIds.append(other.nodeIds[i]);
+  }
+}
+
+void Graph::mergeRoads() {
+  // Group roads by (name, type) and hash both endpoints of every way, so
+  // pieces meeting at a shared node can be found without a pairwise scan.
+  QHash<QString, int> groupIds;
+  QVector<int> groupOf(roads.size(), -1);
+  QMultiHash<QPair<int, qint64>, int> endpoints;
+
+  for (int i = 0; i < roads.size(); ++i) {
+    const Road &road = roads[i];
+    if (road.nodeIds.size() < 2)
+      continue;
+
+    QString key = road.type + QChar('\x1f') + road.name;
+    int group = groupIds.value(key, groupIds.size());
+    groupIds.insert(key, group);
+    groupOf[i] = group;
 
-  for (auto &poly : polygons) {
-    for (auto &pt : poly.nodes) {
-      double normX = (pt.x() - minLon) * scale;
-      double normY = (maxLat - pt.y()) * (-scale);
-      pt.setX(normX);
-      pt.setY(normY);
+    endpoints.insert(qMakePair(group, road.nodeIds.first()), i);
+    endpoints.insert(qMakePair(group, road.nodeIds.last()), i);
+  }
+
+  QVector<bool> used(roads.size(), false);
+  auto takeNeighbour = [&](int group, qint64 nodeId) {
+    auto key = qMakePair(group, nodeId);
+    for (auto it = endpoints.constFind(key);
+         it != endpoints.constEnd() && it.key() == key; ++it) {
+      if (!used[it.value()]) {
+        used[it.value()] = true;
+        return it.value();
+      }
+    }
+    return -1;
+  };
+
+  QList<Road> merged;
+  merged.reserve(roads.size());
+
+  for (int i = 0; i < roads.size(); ++i) {
+    if (used[i])
+      continue;
+    used[i] = true;
+
+    Road road = roads[i];
+    int group = groupOf[i];
+    if (group < 0) {
+      merged.append(road);
+      continue;
+    }
+
+    // Grow forward from the tail, then flip and grow from the old head.
+    for (int pass = 0; pass < 2; ++pass) {
+      while (road.nodeIds.first() != road.nodeIds.last()) {
+        int next = takeNeighbour(group, road.nodeIds.last());
+        if (next < 0)
+          break;
+        appendRoad(road, roads[next]);
+      }
+      std::reverse(road.nodes.begin(), road.nodes.end());
+      std::reverse(road.nodeIds.begin(), road.nodeIds.end());
     }
+
+    merged.append(road);
   }
 
-  for (auto &road : roads) {
-    for (auto &pt : road.nodes) {
-      double normX = (pt.x() - minLon) * scale;
-      double normY = (maxLat - pt.y()) * (-scale);
-      pt.setX(normX);
-      pt.setY(normY);
+  roads = merged;
+}
+
+void Graph::buildSpatialIndex() {
+  QVector<QRectF> boxes;
+
+  boxes.reserve(buildings.size());
+  for (const auto &poly : buildings)
+    boxes.append(boundsOf(poly.nodes));
+  buildingIndex.build(boxes);
+
+  boxes.clear();
+  for (const auto &poly : polygons)
+    boxes.append(boundsOf(poly.nodes));
+  polygonIndex.build(boxes);
+
+  boxes.clear();
+  for (const auto &road : roads)
+    boxes.append(boundsOf(road.nodes));
+  roadIndex.build(boxes);
+}
+
+// Position along a Hilbert curve filling a 2^16 x 2^16 grid
+static quint64 hilbertIndex(quint32 x, quint32 y) {
+  const quint32 n = 1u << 16;
+  quint64 d = 0;
+  for (quint32 s = n / 2; s > 0; s /= 2) {
+    quint32 rx = (x & s) > 0;
+    quint32 ry = (y & s) > 0;
+    d += quint64(s) * s * ((3 * rx) ^ ry);
+    if (ry == 0) {
+      if (rx == 1) {
+        x = n - 1 - x;
+        y = n - 1 - y;
+      }
+      std::swap(x, y);
+    }
+  }
+  return d;
+}
+
+// Reorders list by key(item), keeping equal keys in their current order
+template <typename List, typename KeyFn>
+static void sortByKey(List &list, KeyFn key) {
+  QVector<QPair<quint64, int>> keyed;
+  keyed.reserve(list.size());
+  for (int i = 0; i < list.size(); ++i)
+    keyed.append(qMakePair(key(list[i]), i));
+  std::stable_sort(keyed.begin(), keyed.end(),
+                   [](const auto &a, const auto &b) { return a.first < b.first; });
+
+  List sorted;
+  sorted.reserve(list.size());
+  for (const auto &k : keyed)
+    sorted.append(std::move(list[k.second]));
+  list = std::move(sorted);
+}
+
+void Graph::sortByHilbert() {
+  QElapsedTimer timer;
+  timer.start();
+
+  // Grid over the centers of everything we are going to sort
+  double minX = 1e18, minY = 1e18, maxX = -1e18, maxY = -1e18;
+  auto extend = [&](const QRectF &box) {
+    QPointF c = box.center();
+    minX = std::min(minX, c.x());
+    minY = std::min(minY, c.y());
+    maxX = std::max(maxX, c.x());
+    maxY = std::max(maxY, c.y());
+  };
+  for (const auto &poly : buildings)
+    extend(boundsOf(poly.nodes));
+  for (const auto &poly : polygons)
+    extend(boundsOf(poly.nodes));
+  for (const auto &road : roads)
+    extend(boundsOf(road.nodes));
+  if (minX > maxX)
+    return;
+
+  const double cell = std::max(maxX - minX, maxY - minY) / 65535.0;
+  auto curveKey = [&](const QPointF &pt) {
+    if (cell <= 0)
+      return quint64(0);
+    // Edge start points can fall outside the grid of centers; clamp before
+    // the cast, negative doubles don't convert to unsigned
+    auto gridCell = [&](double offset) {
+      return quint32(std::clamp(offset / cell, 0.0, 65535.0));
+    };
+    return hilbertIndex(gridCell(pt.x() - minX), gridCell(pt.y() - minY));
+  };
+
+  sortByKey(buildings, [&](const PolygonArea &p) {
+    return curveKey(boundsOf(p.nodes).center());
+  });
+  sortByKey(polygons, [&](const PolygonArea &p) {
+    return curveKey(boundsOf(p.nodes).center());
+  });
+  sortByKey(roads, [&](const Road &r) {
+    return curveKey(boundsOf(r.nodes).center());
+  });
+  // Dense node numbering (components, Router) follows edge order, so sorting
+  // edges also lays the node tables out along the curve
+  sortByKey(edges, [&](const Edge &e) {
+    return e.geometry.empty() ? quint64(0) : curveKey(e.geometry.front());
+  });
+
+  qDebug() << "Hilbert reorder of" << buildings.size() + polygons.size()
+           << "areas," << roads.size() << "roads," << edges.size()
+           << "edges took" << timer.elapsed() << "ms";
+}
+
+void Graph::classifyFeatures() {
+  for (Road &road : roads)
+    road.featureClass = roadClass(road.type);
+  for (PolygonArea &building : buildings)
+    building.featureClass = FeatureClass::Building;
+  for (PolygonArea &poly : polygons)
+    poly.featureClass = areaClass(poly);
+
+  // Stable, so each bucket stays in Hilbert order. Unknown road types sort
+  // after the last bucket and are never drawn.
+  sortByKey(roads, [](const Road &r) { return quint64(r.featureClass); });
+  sortByKey(polygons,
+            [](const PolygonArea &p) { return quint64(p.featureClass); });
+
+  auto bucketStarts = [](const auto &list, int first, int count) {
+    QVector<int> starts(count + 1, 0);
+    for (const auto &item : list) {
+      int c = int(item.featureClass) - first;
+      if (c >= 0 && c < count)
+        ++starts[c + 1];
     }
+    for (int c = 0; c < count; ++c)
+      starts[c + 1] += starts[c];
+    return starts;
+  };
+  roadClassStart = bucketStarts(roads, 0, roadClassCount);
+  areaClassStart = bucketStarts(polygons, firstAreaClass, areaClassCount);
+}
+
+// Lock-free union-find over dense node indices. Roots are always linked from
+// the higher index to the lower one, so concurrent unions cannot form cycles.
+static int findRoot(std::vector<std::atomic<int>> &parent, int x) {
+  while (true) {
+    int p = parent[x].load(std::memory_order_relaxed);
+    if (p == x)
+      return x;
+    int gp = parent[p].load(std::memory_order_relaxed);
+    if (gp != p) // Path halving
+      parent[x].compare_exchange_weak(p, gp, std::memory_order_relaxed);
+    x = gp;
+  }
+}
+
+static void unite(std::vector<std::atomic<int>> &parent, int a, int b) {
+  while (true) {
+    a = findRoot(parent, a);
+    b = findRoot(parent, b);
+    if (a == b)
+      return;
+    if (a < b)
+      std::swap(a, b);
+    int expected = a;
+    if (parent[a].compare_exchange_strong(expected, b))
+      return;
   }
+}
+
+// Runs fn(begin, end) over [0, count) split across the available cores.
+template <typename Fn> static void parallelFor(int count, Fn fn) {
+  int threads = std::max(1u, std::thread::hardware_concurrency());
+  threads = std::min(threads, std::max(1, count / 1024));
+  if (threads <= 1) {
+    fn(0, count);
+    return;
+  }
+
+  std::vector<std::thread> workers;
+  int chunk = (count + threads - 1) / threads;
+  for (int t = 0; t < threads; ++t) {
+    int begin = t * chunk;
+    int end = std::min(count, begin + chunk);
+    if (begin < end)
+      workers.emplace_back(fn, begin, end);
+  }
+  for (auto &worker : workers)
+    worker.join();
+}
+
+void Graph::computeComponents(int minIslandSize) {
+  weakComponent.clear();
+  strongComponent.clear();
+  weakComponentSizes.clear();
+
+  // Dense indices for every node that takes part in an edge
+  QHash<qint64, int> index;
+  QVector<qint64> ids;
+  std::vector<QPair<int, int>> links(edges.size());
+  auto indexOf = [&](qint64 id) {
+    auto it = index.constFind(id);
+    if (it != index.constEnd())
+      return it.value();
+    index.insert(id, ids.size());
+    ids.append(id);
+    return int(ids.size() - 1);
+  };
+  for (int i = 0; i < edges.size(); ++i)
+    links[i] = qMakePair(indexOf(edges[i].from), indexOf(edges[i].to));
+
+  const int n = ids.size();
+  if (n == 0)
+    return;
+
+  // Step 1: Weak components with a parallel union-find over all edges
+  std::vector<std::atomic<int>> parent(n);
+  for (int i = 0; i < n; ++i)
+    parent[i].store(i, std::memory_order_relaxed);
+
+  parallelFor(int(links.size()), [&](int begin, int end) {
+    for (int i = begin; i < end; ++i)
+      unite(parent, links[i].first, links[i].second);
+  });
+
+  std::vector<int> weak(n, -1);
+  std::vector<int> rootLabel(n, -1);
+  for (int i = 0; i < n; ++i) {
+    int root = findRoot(parent, i);
+    if (rootLabel[root] < 0) {
+      rootLabel[root] = weakComponentSizes.size();
+      weakComponentSizes.append(0);
+    }
+    weak[i] = rootLabel[root];
+    ++weakComponentSizes[weak[i]];
+  }
+
+  // Step 2: Strong components (oneway aware) with an iterative Tarjan.
+  // Weak components are independent, so each worker takes a share of them.
+  std::vector<int> offsets(n + 1, 0);
+  for (int i = 0; i < edges.size(); ++i) {
+    ++offsets[links[i].first + 1];
+    if (!edges[i].oneway)
+      ++offsets[links[i].second + 1];
+  }
+  for (int i = 0; i < n; ++i)
+    offsets[i + 1] += offsets[i];
+
+  std::vector<int> targets(offsets[n]);
+  std::vector<int> fill = offsets;
+  for (int i = 0; i < edges.size(); ++i) {
+    targets[fill[links[i].first]++] = links[i].second;
+    if (!edges[i].oneway)
+      targets[fill[links[i].second]++] = links[i].first;
+  }
+
+  std::vector<std::vector<int>> members(weakComponentSizes.size());
+  for (int i = 0; i < n; ++i)
+    members[weak[i]].push_back(i);
+
+  std::vector<int> strong(n, -1);
+  std::vector<int> order(n, -1);
+  std::vector<int> low(n, 0);
+  std::atomic<int> nextStrong{0};
+
+  parallelFor(int(members.size()), [&](int begin, int end) {
+    std::vector<int> stack;
+    std::vector<QPair<int, int>> callStack; // (node, next edge slot)
+    int counter = 0;
+
+    for (int c = begin; c < end; ++c) {
+      for (int start : members[c]) {
+        if (order[start] >= 0)
+          continue;
+
+        callStack.push_back(qMakePair(start, offsets[start]));
+        order[start] = low[start] = counter++;
+        stack.push_back(start);
+
+        while (!callStack.empty()) {
+          int v = callStack.back().first;
+          int &slot = callStack.back().second;
+
+          if (slot < offsets[v + 1]) {
+            int w = targets[slot++];
+            if (order[w] < 0) {
+              order[w] = low[w] = counter++;
+              stack.push_back(w);
+              callStack.push_back(qMakePair(w, offsets[w]));
+            } else if (strong[w] < 0) {
+              low[v] = std::min(low[v], order[w]);
+            }
+            continue;
+          }
+
+          callStack.pop_back();
+          if (!callStack.empty()) {
+            int u = callStack.back().first;
+            low[u] = std::min(low[u], low[v]);
+          }
+
+          if (low[v] == order[v]) {
+            int label = nextStrong.fetch_add(1);
+            int w;
+            do {
+              w = stack.back();
+              stack.pop_back();
+              strong[w] = label;
+            } while (w != v);
+          }
+        }
+      }
+    }
+  });
+
+  weakComponent.reserve(n);
+  strongComponent.reserve(n);
+  for (int i = 0; i < n; ++i) {
+    weakComponent.insert(ids[i], weak[i]);
+    strongComponent.insert(ids[i], strong[i]);
+  }
+
+  // Step 3: Flag edges that live on small disconnected fragments
+  int islandEdges = 0;
+  for (int i = 0; i < edges.size(); ++i) {
+    edges[i].onIsland =
+        weakComponentSizes[weak[links[i].first]] < minIslandSize;
+    islandEdges += edges[i].onIsland;
+  }
+
+  qDebug() << "Road network:" << weakComponentSizes.size()
+           << "weak components," << nextStrong.load() << "strong components,"
+           << islandEdges << "edges on islands";
+}
+
+void Graph::pruneIslands() {
+  QVector<Edge> kept;
+  kept.reserve(edges.size());
+  for (const Edge &edge : edges) {
+    if (!edge.onIsland)
+      kept.append(edge);
+  }
+  edges = kept;
+}
+
+bool Graph::mayReach(qint64 from, qint64 to) const {
+  auto a = weakComponent.constFind(from);
+  auto b = weakComponent.constFind(to);
+  if (a == weakComponent.constEnd() || b == weakComponent.constEnd())
+    return false;
+  return a.value() == b.value();
+}
+
+QVector<QPointF> PolygonArea::vertices() const {
+  QVector<QPointF> out = nodes;
+  for (const auto &hole : holes)
+    out += hole;
+  return out;
+}
+
+void Graph::triangulatePolygons() {
+  auto run = [](auto &areas) {
+    parallelFor(int(areas.size()), [&](int begin, int end) {
+      for (int i = begin; i < end; ++i)
+        areas[i].triangles = triangulate(areas[i].nodes, areas[i].holes);
+    });
+  };
+  // Detach up front, worker threads must not trigger copy-on-write
+  buildings.detach();
+  polygons.detach();
+  run(buildings);
+  run(polygons);
+
+  qint64 triangleCount = 0;
+  for (const auto &poly : buildings)
+    triangleCount += poly.triangles.size() / 3;
+  for (const auto &poly : polygons)
+    triangleCount += poly.triangles.size() / 3;
+  qDebug() << "Triangulated" << buildings.size() + polygons.size()
+           << "polygons into" << triangleCount << "triangles";
+}
+
+double Graph::lodTolerance(int lod) {
+  // Quadtree level 0 shows the ~1000 unit map on a 512 px tile
+  return 0.5 * (1000.0 / 512.0) / double(1 << lod);
+}
+
+void Graph::simplifyGeometry() {
+  QElapsedTimer timer;
+  timer.start();
+
+  // Step 1: Pin nodes shared between features, so neighbours simplify to
+  // the same junctions and borders. Roads share OSM node ids, areas only
+  // share coordinates.
+  QHash<qint64, int> roadNodeUses;
+  for (const Road &road : roads) {
+    for (qint64 id : road.nodeIds)
+      ++roadNodeUses[id];
+  }
+
+  QHash<QPair<double, double>, int> areaPointUses;
+  auto countRing = [&](const QVector<QPointF> &ring) {
+    int n = ring.size() - (ring.size() > 1 && ring.first() == ring.last());
+    for (int i = 0; i < n; ++i)
+      ++areaPointUses[qMakePair(ring[i].x(), ring[i].y())];
+  };
+  for (const auto *areas : {&buildings, &polygons}) {
+    for (const PolygonArea &area : *areas) {
+      countRing(area.nodes);
+      for (const auto &hole : area.holes)
+        countRing(hole);
+    }
+  }
+  auto areaPins = [&](const QVector<QPointF> &ring) {
+    QVector<bool> pinned(ring.size());
+    for (int i = 0; i < ring.size(); ++i)
+      pinned[i] = areaPointUses.value(qMakePair(ring[i].x(), ring[i].y())) > 1;
+    return pinned;
+  };
+
+  // Step 2: Simplify every level in parallel. Levels that keep every point
+  // share the full geometry instead of copying it.
+  roads.detach();
+  parallelFor(int(roads.size()), [&](int begin, int end) {
+    for (int r = begin; r < end; ++r) {
+      Road &road = roads[r];
+      QVector<bool> pinned(road.nodes.size());
+      if (road.nodeIds.size() == road.nodes.size()) {
+        for (int i = 0; i < road.nodes.size(); ++i)
+          pinned[i] = roadNodeUses.value(road.nodeIds[i]) > 1;
+      }
+
+      road.lodNodes.resize(lodLevels);
+      for (int lod = 0; lod < lodLevels; ++lod) {
+        QVector<int> kept =
+            simplifyPolyline(road.nodes, lodTolerance(lod), pinned);
+        if (kept.size() == road.nodes.size()) {
+          road.lodNodes[lod] = road.nodes;
+          continue;
+        }
+        for (int i : kept)
+          road.lodNodes[lod].append(road.nodes[i]);
+      }
+    }
+  });
+
+  auto simplifyAreas = [&](auto &areas) {
+    areas.detach();
+    parallelFor(int(areas.size()), [&](int begin, int end) {
+      for (int a = begin; a < end; ++a) {
+        PolygonArea &area = areas[a];
+        QVector<bool> outerPins = areaPins(area.nodes);
+        QVector<QVector<bool>> holePins;
+        for (const auto &hole : area.holes)
+          holePins.append(areaPins(hole));
+
+        const QVector<QPointF> full = area.vertices();
+        area.lods.resize(lodLevels);
+        for (int lod = 0; lod < lodLevels; ++lod) {
+          AreaLod &level = area.lods[lod];
+          const double tolerance = lodTolerance(lod);
+          QVector<QPointF> outer =
+              simplifyRing(area.nodes, tolerance, outerPins);
+          if (outer.isEmpty())
+            continue;
+
+          QVector<QVector<QPointF>> holes;
+          bool unchanged = outer.size() == area.nodes.size();
+          for (int h = 0; h < area.holes.size(); ++h) {
+            QVector<QPointF> hole =
+                simplifyRing(area.holes[h], tolerance, holePins[h]);
+            unchanged = unchanged && hole.size() == area.holes[h].size();
+            if (!hole.isEmpty())
+              holes.append(hole);
+          }
+
+          if (unchanged) {
+            level.vertices = full;
+            level.ringSizes.append(area.nodes.size());
+            for (const auto &hole : area.holes)
+              level.ringSizes.append(hole.size());
+            level.triangles = area.triangles;
+            continue;
+          }
+          level.vertices = outer;
+          level.ringSizes.append(outer.size());
+          for (const auto &hole : holes) {
+            level.vertices += hole;
+            level.ringSizes.append(hole.size());
+          }
+          level.triangles = triangulate(outer, holes);
+        }
+      }
+    });
+  };
+  simplifyAreas(buildings);
+  simplifyAreas(polygons);
 
-  for (auto &edge : edges) {
-    for (auto &pt : edge.geometry) {
-      double normX = (pt.x() - minLon) * scale;
-      double normY = (maxLat - pt.y()) * (-scale);
-      pt.setX(normX);
-      pt.setY(normY);
+  // Step 3: Report what each level costs
+  for (int lod = 0; lod < lodLevels; ++lod) {
+    qint64 roadPoints = 0, areaPoints = 0;
+    for (const Road &road : roads)
+      roadPoints += road.lodNodes[lod].size();
+    for (const auto *areas : {&buildings, &polygons}) {
+      for (const PolygonArea &area : *areas)
+        areaPoints += area.lods[lod].vertices.size();
     }
+    qDebug() << "LOD" << lod << "tolerance" << lodTolerance(lod) << ":"
+             << roadPoints << "road points," << areaPoints << "area points";
   }
+  qDebug() << "Simplified geometry in" << timer.elapsed() << "ms";
 }
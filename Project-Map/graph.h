@@ -1,8 +1,12 @@
 #pragma once
+#include "feature_rules.h"
+#include "spatial_index.h"
+#include <QHash>
 #include <QMap>
 #include <QPointF>
 #include <QString>
 #include <QVector>
+#include <algorithm>
 
 struct Node {
   qint64 id;
@@ -18,6 +22,7 @@ struct Edge {
   std::string name; // NEW: Road name (if available)
   std::string highwayType;
   bool oneway;
+  bool onIsland = false; // Part of a small disconnected fragment
 
   std::vector<QPointF> geometry;
 };
@@ -27,13 +32,54 @@ struct Road {
   QString name;
   QString type;
   QVector<QPointF> nodes;
+  QVector<qint64> nodeIds; // OSM node ids, parallel to nodes
+  FeatureClass featureClass = FeatureClass::Count; // From type, at load
+
+  // Simplified nodes per level of detail, coarsest first (Graph::lodLevels)
+  QVector<QVector<QPointF>> lodNodes;
+  const QVector<QPointF> &nodesAt(int lod) const {
+    return lod >= 0 && lod < lodNodes.size() ? lodNodes[lod] : nodes;
+  }
+};
+
+// Simplified shape of an area at one level of detail. Empty triangles mean
+// the area is too small to draw at that level.
+struct AreaLod {
+  QVector<QPointF> vertices; // Outer ring followed by the holes
+  QVector<int> ringSizes;    // Points per ring in vertices, outer first
+  QVector<quint32> triangles;
 };
 
 struct PolygonArea {
   qint64 id;
   QVector<QPointF> nodes; // Lat/Lon converted to screen space
+  QVector<QVector<QPointF>> holes; // Inner rings of multipolygons
   QMap<QString, QString> tags;
+  FeatureClass featureClass = FeatureClass::OtherArea; // From tags, at load
+
+  // Filled by Graph::triangulatePolygons: three indices per triangle into
+  // nodes followed by every hole, see vertices()
+  QVector<quint32> triangles;
+  QVector<QPointF> vertices() const;
+
+  QVector<AreaLod> lods; // Filled by Graph::simplifyGeometry, coarsest first
 };
+
+// Bounding box of a polyline or ring, null when it has no points
+template <typename Points> QRectF boundsOf(const Points &points) {
+  if (points.isEmpty())
+    return QRectF();
+  double minX = points[0].x(), maxX = minX;
+  double minY = points[0].y(), maxY = minY;
+  for (const QPointF &pt : points) {
+    minX = std::min(minX, pt.x());
+    maxX = std::max(maxX, pt.x());
+    minY = std::min(minY, pt.y());
+    maxY = std::max(maxY, pt.y());
+  }
+  return QRectF(QPointF(minX, minY), QPointF(maxX, maxY));
+}
+
 struct AreaLabel {
   std::string name;
   QPointF center; // in lat/lon
@@ -59,4 +105,49 @@ public:
   const std::vector<AreaLabel> &getAreas() const { return areaLabels; }
 
   void normalizeCoordinates(); // Normalize all lat/lon to screen space
+
+  // Sizes of the feature lists, to tell features appended later apart
+  struct FeatureCounts {
+    int buildings = 0;
+    int polygons = 0;
+    int roads = 0;
+    int edges = 0;
+  };
+  FeatureCounts featureCounts() const;
+  // Normalizes the features appended after since, in the frame set up by
+  // normalizeCoordinates. Returns the area they cover.
+  QRectF normalizeAppended(const FeatureCounts &since);
+  void mergeRoads(); // Stitch split ways of the same street into polylines
+  void sortByHilbert(); // Store features in Hilbert order of their centers
+
+  // Draw buckets. classifyFeatures resolves every road and area class once
+  // and regroups roads and polygons by class, keeping Hilbert order inside a
+  // class. Bucket c spans [classStart[c], classStart[c + 1]).
+  QVector<int> roadClassStart; // roadClassCount + 1 entries
+  QVector<int> areaClassStart; // areaClassCount + 1 entries, from firstAreaClass
+  void classifyFeatures(); // Call after sortByHilbert, before buildSpatialIndex
+  void triangulatePolygons(); // Cache fill triangles of buildings/polygons
+
+  // Levels of detail for zoomed-out tiles. Level k is simplified to about
+  // half a pixel at quadtree level k of the ~1000 unit normalized map; deeper
+  // levels draw the full geometry.
+  static constexpr int lodLevels = 6;
+  static double lodTolerance(int lod);
+  void simplifyGeometry(); // Call after mergeRoads/triangulatePolygons
+
+  // Bounding-box indices over the normalized geometry, for viewport culling
+  RTree buildingIndex;
+  RTree polygonIndex;
+  RTree roadIndex;
+  void buildSpatialIndex(); // Call after normalizeCoordinates/mergeRoads
+
+  // Road network connectivity, keyed by node id. Weak components ignore
+  // oneway, strong components respect it.
+  QHash<qint64, int> weakComponent;
+  QHash<qint64, int> strongComponent;
+  QVector<int> weakComponentSizes;
+  void computeComponents(int minIslandSize = 50);
+  void pruneIslands(); // Drop edges flagged by computeComponents
+  // False only when no path can exist, so routing can bail out in O(1)
+  bool mayReach(qint64 from, qint64 to) const;
 };
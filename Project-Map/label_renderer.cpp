@@ -0,0 +1,376 @@
+#include "label_renderer.h"
+#include "map_renderer.h"
+#include <QDebug>
+#include <QLineF>
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+namespace {
+
+constexpr int positionAttribute = 0;
+constexpr int texCoordAttribute = 1;
+
+const char *labelVertexShader = R"(
+ATTRIBUTE vec2 a_position;
+ATTRIBUTE vec2 a_texCoord;
+uniform mat4 u_matrix;
+uniform vec2 u_atlasSize;
+VARYING vec2 v_texCoord;
+
+void main() {
+  v_texCoord = a_texCoord / u_atlasSize;
+  gl_Position = u_matrix * vec4(a_position, 0.0, 1.0);
+}
+)";
+
+const char *labelFragmentShader = R"(
+VARYING vec2 v_texCoord;
+uniform sampler2D u_atlas;
+uniform vec4 u_color;
+uniform float u_smoothing; // Half a screen pixel in distance field units
+
+void main() {
+  float distance = TEXTURE(u_atlas, v_texCoord).a;
+  float alpha = smoothstep(0.5 - u_smoothing, 0.5 + u_smoothing, distance);
+  FRAG_COLOR = vec4(u_color.rgb, u_color.a * alpha);
+}
+)";
+
+} // namespace
+
+LabelRenderer::LabelRenderer(const Graph &g) : graph(g) {}
+
+LabelRenderer::~LabelRenderer() {
+  if (pending.valid())
+    pending.wait(); // The job only holds its own copies, but don't leak it
+}
+
+void LabelRenderer::initialize() {
+  initializeOpenGLFunctions();
+
+  program.addShaderFromSourceCode(
+      QOpenGLShader::Vertex, MapRenderer::shaderSource(labelVertexShader, true));
+  program.addShaderFromSourceCode(
+      QOpenGLShader::Fragment,
+      MapRenderer::shaderSource(labelFragmentShader, false));
+  program.bindAttributeLocation("a_position", positionAttribute);
+  program.bindAttributeLocation("a_texCoord", texCoordAttribute);
+  if (!program.link())
+    qWarning() << "Label shader failed to link:" << program.log();
+
+  vao.create(); // Stays uncreated where VAOs are unsupported
+  buffer.create();
+}
+
+void LabelRenderer::cleanup() {
+  texture.reset();
+  buffer.destroy();
+  vao.destroy();
+  hasLayout = false;
+}
+
+void LabelRenderer::invalidate() {
+  stale = true;
+  refreshing = false;
+}
+
+void LabelRenderer::invalidate(const QRectF &changed) {
+  if (stale && !refreshing)
+    return; // Everything is rebuilt anyway
+  stale = true;
+  refreshing = true;
+  refreshArea = refreshArea.united(changed);
+}
+
+quint32 LabelRenderer::zoomBucket(float zoom) {
+  quint32 bucket = 0;
+  for (int c = 0; c < roadClassCount; ++c) {
+    if (isVisibleAt(FeatureClass(c), zoom))
+      bucket |= 1u << c;
+  }
+  return bucket;
+}
+
+// Snapshots the named roads with their arc-length tables and puts every
+// character into the atlas, so layout jobs never touch Graph or the atlas
+void LabelRenderer::prepareSources() {
+  auto prepared = std::make_shared<QVector<LabelSource>>();
+  for (const Road &road : graph.roads) {
+    if (road.name.isEmpty() || road.nodes.size() < 2 ||
+        road.featureClass == FeatureClass::Count)
+      continue;
+
+    LabelSource source{road.name, road.nodes, {}, road.featureClass};
+    source.arcLength.reserve(road.nodes.size());
+    float length = 0.0f;
+    source.arcLength.append(length);
+    for (int i = 1; i < road.nodes.size(); ++i) {
+      length += QLineF(road.nodes[i - 1], road.nodes[i]).length();
+      source.arcLength.append(length);
+    }
+    prepared->append(source);
+
+    for (QChar ch : road.name)
+      atlas.glyph(ch);
+  }
+  sources = prepared;
+  stale = false;
+}
+
+void LabelRenderer::startLayout(quint32 bucket) {
+  pendingBucket = bucket;
+  pending = std::async(std::launch::async,
+                       [sources = sources, glyphs = atlas.glyphTable(),
+                        bucket]() { return layout(*sources, glyphs, bucket); });
+}
+
+// Moves a finished layout job into the layout cache, if there is one
+void LabelRenderer::collectLayout() {
+  if (!pending.valid() ||
+      pending.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+    return;
+
+  QVector<LabelVertex> vertices = pending.get();
+  pending = {};
+
+  // Over budget: drop other buckets, never the one on screen
+  cachedBytes += vertices.size() * sizeof(LabelVertex);
+  for (auto it = layouts.begin();
+       it != layouts.end() && cachedBytes > layoutBudget;) {
+    if (it.key() == currentBucket && hasLayout) {
+      ++it;
+      continue;
+    }
+    cachedBytes -= it.value().size() * sizeof(LabelVertex);
+    it = layouts.erase(it);
+  }
+  layouts.insert(pendingBucket, vertices);
+}
+
+void LabelRenderer::upload(quint32 bucket) {
+  const QVector<LabelVertex> &vertices = layouts[bucket];
+  if (vao.isCreated())
+    vao.bind();
+  buffer.bind();
+  buffer.allocate(vertices.constData(),
+                  int(vertices.size() * sizeof(LabelVertex)));
+  glEnableVertexAttribArray(positionAttribute);
+  glEnableVertexAttribArray(texCoordAttribute);
+  glVertexAttribPointer(positionAttribute, 2, GL_FLOAT, GL_FALSE,
+                        sizeof(LabelVertex), nullptr);
+  glVertexAttribPointer(texCoordAttribute, 2, GL_FLOAT, GL_FALSE,
+                        sizeof(LabelVertex),
+                        reinterpret_cast<const void *>(offsetof(LabelVertex, u)));
+  if (vao.isCreated())
+    vao.release();
+  buffer.release();
+
+  vertexCount = vertices.size();
+  currentBucket = bucket;
+  hasLayout = true;
+}
+
+bool LabelRenderer::update(const Camera &camera) {
+  bool changed = false;
+  if (stale) {
+    if (pending.valid())
+      pending.wait(); // Finish against the old sources, then drop it
+    pending = {};
+    layouts.clear();
+    cachedBytes = 0;
+    if (!refreshing) {
+      hasLayout = false;
+      changed = true;
+      changeArea = QRectF();
+    }
+    prepareSources();
+  }
+
+  // Keep drawing the previous bucket while the next one is laid out
+  collectLayout();
+  const quint32 wantedBucket = zoomBucket(camera.zoom);
+  if (hasLayout && wantedBucket == currentBucket && !refreshing) {
+    waitingForLayout = false;
+    return changed;
+  }
+
+  if (layouts.contains(wantedBucket)) {
+    if (!waitingForLayout)
+      ++stats.hits; // Laid out ahead of time
+    waitingForLayout = false;
+    // Same bucket laid out again: only the refreshed roads' glyphs moved,
+    // and those stay within a couple of ems of their road
+    const double reach = 2 * fontSize;
+    changeArea = refreshing && hasLayout && wantedBucket == currentBucket
+                     ? refreshArea.adjusted(-reach, -reach, reach, reach)
+                     : QRectF();
+    refreshing = false;
+    refreshArea = QRectF();
+    upload(wantedBucket);
+    return true;
+  }
+  if (!waitingForLayout) {
+    if (!refreshing)
+      ++stats.misses;
+    waitingForLayout = true;
+  }
+  if (!pending.valid())
+    startLayout(wantedBucket);
+  return changed;
+}
+
+void LabelRenderer::prefetch(float zoom) {
+  if (stale || pending.valid())
+    return;
+  const quint32 bucket = zoomBucket(zoom);
+  if (!layouts.contains(bucket)) {
+    ++stats.prefetched;
+    startLayout(bucket);
+  }
+}
+
+void LabelRenderer::draw(const Camera &camera) {
+  if (!hasLayout || vertexCount == 0)
+    return;
+
+  // New glyphs were rasterized, upload the whole atlas again
+  if (atlas.isDirty() || !texture) {
+    texture = std::make_unique<QOpenGLTexture>(
+        atlas.image(), QOpenGLTexture::DontGenerateMipMaps);
+    texture->setMinificationFilter(QOpenGLTexture::Linear);
+    texture->setMagnificationFilter(QOpenGLTexture::Linear);
+    texture->setWrapMode(QOpenGLTexture::ClampToEdge);
+    atlas.markClean();
+  }
+
+  const float scale = fontSize / GlyphAtlas::fontPixelSize;
+  const float screenPerAtlasPx = camera.zoom * scale;
+  const float smoothing =
+      std::min(0.5f, 0.5f / (2.0f * GlyphAtlas::spread * screenPerAtlasPx));
+
+  program.bind();
+  program.setUniformValue("u_matrix", camera.viewMatrix());
+  program.setUniformValue("u_atlasSize", QVector2D(atlas.image().width(),
+                                                   atlas.image().height()));
+  program.setUniformValue("u_atlas", 0);
+  program.setUniformValue("u_color", QColor(Qt::black));
+  program.setUniformValue("u_smoothing", smoothing);
+  texture->bind(0);
+
+  if (vao.isCreated()) {
+    vao.bind();
+  } else {
+    buffer.bind();
+    glEnableVertexAttribArray(positionAttribute);
+    glEnableVertexAttribArray(texCoordAttribute);
+    glVertexAttribPointer(positionAttribute, 2, GL_FLOAT, GL_FALSE,
+                          sizeof(LabelVertex), nullptr);
+    glVertexAttribPointer(
+        texCoordAttribute, 2, GL_FLOAT, GL_FALSE, sizeof(LabelVertex),
+        reinterpret_cast<const void *>(offsetof(LabelVertex, u)));
+  }
+
+  // Off-screen glyphs are clipped by the GPU, cheaper than re-culling
+  glDrawArrays(GL_TRIANGLES, 0, vertexCount);
+
+  if (vao.isCreated()) {
+    vao.release();
+  } else {
+    glDisableVertexAttribArray(texCoordAttribute);
+    buffer.release();
+  }
+  texture->release();
+  program.release();
+}
+
+namespace {
+
+void appendGlyph(QVector<LabelRenderer::LabelVertex> &out, const Glyph &glyph,
+                 const QPointF &pos, float angle, float charWidth,
+                 float scale) {
+  const float c = std::cos(angle);
+  const float s = std::sin(angle);
+  const QRectF &q = glyph.quad;
+  const QRect &t = glyph.texRect;
+
+  // Glyph space is y-down, the map is y-up
+  auto corner = [&](double gx, double gy, float u, float v) {
+    const float lx = float(gx) * scale - charWidth / 2;
+    const float ly = -float(gy) * scale;
+    return LabelRenderer::LabelVertex{float(pos.x()) + lx * c - ly * s,
+                                      float(pos.y()) + lx * s + ly * c, u, v};
+  };
+  const auto topLeft = corner(q.left(), q.top(), t.left(), t.top());
+  const auto topRight =
+      corner(q.right(), q.top(), t.left() + t.width(), t.top());
+  const auto bottomRight = corner(q.right(), q.bottom(), t.left() + t.width(),
+                                  t.top() + t.height());
+  const auto bottomLeft =
+      corner(q.left(), q.bottom(), t.left(), t.top() + t.height());
+
+  out.append(topLeft);
+  out.append(topRight);
+  out.append(bottomRight);
+  out.append(topLeft);
+  out.append(bottomRight);
+  out.append(bottomLeft);
+}
+
+} // namespace
+
+// Places each character at the arc length of its center along the road,
+// centered on the road and rotated to the segment it falls on
+QVector<LabelRenderer::LabelVertex>
+LabelRenderer::layout(const QVector<LabelSource> &sources,
+                      const QHash<QChar, Glyph> &glyphs,
+                      quint32 visibleClasses) {
+  const float scale = fontSize / GlyphAtlas::fontPixelSize; // Atlas px to map
+  QVector<LabelVertex> out;
+  QVector<Glyph> runs; // Glyphs of the current name
+
+  for (const LabelSource &source : sources) {
+    if (!(visibleClasses & (1u << int(source.featureClass))))
+      continue; // Don't label roads that aren't drawn
+
+    // Total text width from the cached advances
+    runs.clear();
+    float textLength = 0.0f;
+    for (QChar ch : source.name) {
+      runs.append(glyphs.value(ch));
+      textLength += runs.last().advance * scale;
+    }
+
+    // Skip drawing if text is longer than the road
+    const float totalLength = source.arcLength.last();
+    if (textLength >= totalLength)
+      continue;
+
+    // Center the text
+    float charStart = (totalLength - textLength) / 2.0f;
+    int seg = 0;
+    for (const Glyph &glyph : runs) {
+      const float charWidth = glyph.advance * scale;
+      const float charMid = charStart + charWidth / 2;
+      charStart += charWidth;
+
+      // Segment whose arc-length span holds this character's center
+      while (seg + 2 < source.arcLength.size() &&
+             source.arcLength[seg + 1] < charMid)
+        ++seg;
+
+      const QPointF &p1 = source.nodes[seg];
+      const QPointF &p2 = source.nodes[seg + 1];
+      const float segLength = source.arcLength[seg + 1] - source.arcLength[seg];
+      const float t =
+          segLength > 0 ? (charMid - source.arcLength[seg]) / segLength : 0.0f;
+      const QPointF pos = p1 + (p2 - p1) * t;
+      const float angle = std::atan2(p2.y() - p1.y(), p2.x() - p1.x());
+
+      if (!glyph.texRect.isNull())
+        appendGlyph(out, glyph, pos, angle, charWidth, scale);
+    }
+  }
+
+  return out;
+}
@@ -0,0 +1,103 @@
+#pragma once
+#include "camera.h"
+#include "glyph_atlas.h"
+#include "graph.h"
+#include <QOpenGLBuffer>
+#include <QOpenGLFunctions>
+#include <QOpenGLShaderProgram>
+#include <QOpenGLTexture>
+#include <QOpenGLVertexArrayObject>
+#include <future>
+#include <memory>
+
+// Draws road names along their roads from a signed-distance-field glyph
+// atlas. Glyph placement is laid out once per zoom bucket on a worker thread
+// and kept in a static vertex buffer, so panning redraws every label with
+// one draw call and no CPU work. Finished layouts stay cached per bucket,
+// and the bucket of a predicted zoom can be laid out ahead of time.
+class LabelRenderer : protected QOpenGLFunctions {
+public:
+  // Em size in map units: the 1pt font the QPainter labels used, at 96 dpi
+  static constexpr float fontSize = 4.0f / 3.0f;
+
+  struct LabelVertex {
+    float x, y; // Map units
+    float u, v; // Atlas pixels
+  };
+
+  // A named road with its cumulative arc length per node, built once
+  struct LabelSource {
+    QString name;
+    QVector<QPointF> nodes;
+    QVector<float> arcLength; // arcLength[i] = length from nodes[0] to nodes[i]
+    FeatureClass featureClass;
+  };
+
+  explicit LabelRenderer(const Graph &graph);
+  ~LabelRenderer();
+
+  void initialize(); // With the GL context current
+  void cleanup();
+  void invalidate(); // Graph changed, rebuild sources and layout
+  // Only roads inside changed were added or edited. The current labels stay
+  // up until the new layout replaces them.
+  void invalidate(const QRectF &changed);
+  // Picks up finished layouts and starts one for a new zoom bucket. True
+  // when the labels drawn from now on differ from the last frame's.
+  bool update(const Camera &camera);
+  // After update returned true: the map area whose labels changed, invalid
+  // when they may have changed anywhere
+  QRectF changedArea() const { return changeArea; }
+  void draw(const Camera &camera);
+  // The bucket on screen is still being laid out
+  bool isLayoutPending() const { return waitingForLayout; }
+
+  // Lays out the bucket of a zoom we are heading to, if nothing else runs
+  void prefetch(float zoom);
+  // Bucket changes served from the layout cache vs. waited for
+  struct PrefetchStats {
+    qint64 hits = 0;
+    qint64 misses = 0;
+    qint64 prefetched = 0; // Jobs started ahead of time
+  };
+  const PrefetchStats &prefetchStats() const { return stats; }
+  static constexpr qint64 layoutBudget = 32ll * 1024 * 1024; // Cached bytes
+
+  // Glyph quads of every visible road name. Pure function of its inputs, so
+  // it can run on any thread.
+  static QVector<LabelVertex> layout(const QVector<LabelSource> &sources,
+                                     const QHash<QChar, Glyph> &glyphs,
+                                     quint32 visibleClasses);
+
+private:
+  // Labels only change when the set of visible road classes does; their
+  // size is fixed in map units. That set is the zoom bucket.
+  static quint32 zoomBucket(float zoom);
+  void prepareSources();
+  void startLayout(quint32 bucket);
+  void collectLayout();
+  void upload(quint32 bucket);
+
+  const Graph &graph;
+  GlyphAtlas atlas;
+  std::shared_ptr<const QVector<LabelSource>> sources;
+  bool stale = true;
+  bool refreshing = false; // Stale from a partial invalidate
+  QRectF refreshArea;
+  QRectF changeArea;
+
+  std::future<QVector<LabelVertex>> pending;
+  quint32 pendingBucket = 0;
+  QHash<quint32, QVector<LabelVertex>> layouts; // Finished, by bucket
+  qint64 cachedBytes = 0;
+  quint32 currentBucket = 0; // In the vertex buffer
+  bool waitingForLayout = false;
+  bool hasLayout = false;
+  int vertexCount = 0;
+  PrefetchStats stats;
+
+  std::unique_ptr<QOpenGLTexture> texture;
+  QOpenGLShaderProgram program;
+  QOpenGLBuffer buffer{QOpenGLBuffer::VertexBuffer};
+  QOpenGLVertexArrayObject vao;
+};
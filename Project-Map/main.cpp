@@ -3,8 +3,17 @@
 #include "osm_loader.h"
 #include <QApplication>
 #include <QMainWindow>
+#include <QSurfaceFormat>
 
 int main(int argc, char *argv[]) {
+  // Opt-in core profile; the map shaders also run on compatibility contexts
+  if (qEnvironmentVariableIsSet("MINIMAP_CORE_PROFILE")) {
+    QSurfaceFormat format;
+    format.setVersion(3, 3);
+    format.setProfile(QSurfaceFormat::CoreProfile);
+    QSurfaceFormat::setDefaultFormat(format);
+  }
+
   QApplication app(argc, argv);
 
   QMainWindow window;
@@ -0,0 +1,402 @@
+#include "map_renderer.h"
+#include "map_style.h"
+#include <QColor>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QOpenGLContext>
+
+namespace {
+
+const char *mapVertexShader = R"(
+ATTRIBUTE vec2 a_position;
+ATTRIBUTE vec4 a_color;
+uniform mat4 u_matrix;
+VARYING vec4 v_color;
+
+void main() {
+  v_color = a_color;
+  gl_Position = u_matrix * vec4(a_position, 0.0, 1.0);
+}
+)";
+
+const char *mapFragmentShader = R"(
+VARYING vec4 v_color;
+
+void main() {
+  FRAG_COLOR = v_color;
+}
+)";
+
+// Roads: the ribbon is pushed out to the outer (casing) width in pixels and
+// the fragment picks casing or fill color from its distance to the
+// centerline. Depth keeps casings below every fill of the same class and the
+// classes above it, as the old border-then-fill passes did.
+const char *roadVertexShader = R"(
+ATTRIBUTE vec2 a_position;
+ATTRIBUTE vec2 a_extrude;
+ATTRIBUTE vec2 a_edge;
+uniform mat4 u_matrix;
+uniform float u_pixelSize;    // Tile units per pixel
+uniform float u_extrudeRange; // a_extrude arrives divided by it
+uniform float u_halfWidth;    // Outer half width plus antialiasing (px)
+VARYING vec2 v_edge;
+
+void main() {
+  v_edge = a_edge * u_halfWidth;
+  vec2 pos = a_position +
+             a_extrude * (u_extrudeRange * u_halfWidth * u_pixelSize);
+  gl_Position = u_matrix * vec4(pos, 0.0, 1.0);
+}
+)";
+
+const char *roadFragmentShader = R"(
+VARYING vec2 v_edge;
+uniform vec4 u_fillColor;
+uniform vec4 u_casingColor;
+uniform float u_fillHalfWidth;
+uniform float u_casingHalfWidth;
+uniform float u_fillDepth;
+uniform float u_casingDepth;
+
+void main() {
+  float d = length(v_edge);
+  float coverage = 1.0 - smoothstep(u_casingHalfWidth - 0.5,
+                                    u_casingHalfWidth + 0.5, d);
+  if (coverage <= 0.0)
+    discard;
+  float fill = 1.0 - smoothstep(u_fillHalfWidth - 0.5, u_fillHalfWidth + 0.5, d);
+  vec4 color = mix(u_casingColor, u_fillColor, fill);
+  FRAG_COLOR = vec4(color.rgb, color.a * coverage);
+#ifndef GL_ES
+  gl_FragDepth = fill > 0.5 ? u_fillDepth : u_casingDepth;
+#endif
+}
+)";
+
+} // namespace
+
+MapRenderer::MapRenderer(const Graph &graph)
+    : geometryTiles(graph), labels(graph) {}
+
+QByteArray MapRenderer::shaderSource(const char *body, bool vertexShader) {
+  QOpenGLContext *context = QOpenGLContext::currentContext();
+  QByteArray header;
+
+  if (context->isOpenGLES()) {
+    header = "#version 100\nprecision mediump float;\n";
+  } else if (context->format().profile() == QSurfaceFormat::CoreProfile) {
+    // Core profile: no attribute/varying/gl_FragColor
+    header = "#version 330 core\n";
+    if (vertexShader) {
+      header += "#define ATTRIBUTE in\n#define VARYING out\n";
+    } else {
+      header += "#define VARYING in\nout vec4 fragColor;\n"
+                "#define FRAG_COLOR fragColor\n#define TEXTURE texture\n";
+    }
+    return header + body;
+  } else {
+    header = "#version 120\n";
+  }
+
+  header += vertexShader ? "#define ATTRIBUTE attribute\n#define VARYING varying\n"
+                         : "#define VARYING varying\n"
+                           "#define FRAG_COLOR gl_FragColor\n"
+                           "#define TEXTURE texture2D\n";
+  return header + body;
+}
+
+void MapRenderer::initialize() {
+  initializeOpenGLFunctions();
+
+  program.addShaderFromSourceCode(QOpenGLShader::Vertex,
+                                  shaderSource(mapVertexShader, true));
+  program.addShaderFromSourceCode(QOpenGLShader::Fragment,
+                                  shaderSource(mapFragmentShader, false));
+  program.bindAttributeLocation("a_position",
+                                GeometryTiles::positionAttribute);
+  program.bindAttributeLocation("a_color", GeometryTiles::colorAttribute);
+  if (!program.link())
+    qWarning() << "Map shader failed to link:" << program.log();
+  matrixLocation = program.uniformLocation("u_matrix");
+
+  roadProgram.addShaderFromSourceCode(QOpenGLShader::Vertex,
+                                      shaderSource(roadVertexShader, true));
+  roadProgram.addShaderFromSourceCode(QOpenGLShader::Fragment,
+                                      shaderSource(roadFragmentShader, false));
+  roadProgram.bindAttributeLocation("a_position",
+                                    GeometryTiles::positionAttribute);
+  roadProgram.bindAttributeLocation("a_extrude",
+                                    GeometryTiles::extrudeAttribute);
+  roadProgram.bindAttributeLocation("a_edge", GeometryTiles::edgeAttribute);
+  if (!roadProgram.link())
+    qWarning() << "Road shader failed to link:" << roadProgram.log();
+  roadMatrixLocation = roadProgram.uniformLocation("u_matrix");
+
+  uploads.initialize();
+  geometryTiles.setUploadBuffer(&uploads);
+
+  labels.initialize();
+  rasterCache.initialize();
+  rasterCache.setProfiler(&profiler);
+  profiler.initialize();
+}
+
+void MapRenderer::cleanup() {
+  profiler.cleanup();
+  rasterCache.cleanup();
+  labels.cleanup();
+  geometryTiles.clear();
+  frameTiles.clear();
+  uploads.cleanup();
+}
+
+void MapRenderer::invalidate() {
+  geometryTiles.invalidate();
+  labels.invalidate();
+  rasterCache.invalidate();
+}
+
+void MapRenderer::invalidate(const QRectF &changed) {
+  if (changed.isNull())
+    return; // Nothing was added
+  geometryTiles.invalidate(changed);
+  labels.invalidate(changed);
+  rasterCache.invalidate(changed);
+}
+
+void MapRenderer::prefetch(const Camera &predicted) {
+  geometryTiles.prefetch(predicted.visibleMapRect(), predicted.zoom);
+  labels.prefetch(predicted.zoom);
+}
+
+void MapRenderer::waitForPrefetch() { geometryTiles.waitForPrefetch(); }
+
+void MapRenderer::render(const Camera &camera, qreal devicePixelRatio) {
+  QElapsedTimer timer;
+  timer.start();
+  uploads.beginFrame();
+  frameIndices = 0;
+
+  // A finished label layout makes cached tiles out of date, all of them
+  // unless only the labels of a changed area were laid out again
+  if (labels.update(camera)) {
+    const QRectF area = labels.changedArea();
+    if (area.isValid())
+      rasterCache.invalidate(area);
+    else
+      rasterCache.invalidate();
+  }
+
+  // Zooming would re-render every tile each frame, more work than drawing
+  // the layers straight to the screen
+  const bool zooming = camera.zoom != lastZoom;
+  lastZoom = camera.zoom;
+  if (zooming) {
+    renderLayers(camera);
+  } else {
+    // Tiles still missing: draw directly while the cache fills up over the
+    // next frames
+    drawBackground();
+    if (!rasterCache.render(camera, devicePixelRatio,
+                            [this](const Camera &c) { renderLayers(c); }))
+      renderLayers(camera);
+  }
+
+  // Once per displayed frame, however many raster tiles it rendered
+  LevelStats &stats = levelStats[geometryTiles.levelForZoom(camera.zoom)];
+  ++stats.frames;
+  stats.nanos += timer.nsecsElapsed();
+  stats.indices += frameIndices;
+  if (++statsFrames == statsInterval)
+    reportLevelStats();
+}
+
+void MapRenderer::renderLayers(const Camera &camera) {
+  drawBackground();
+
+  glEnable(GL_BLEND);
+  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+  frameTiles = geometryTiles.visibleTiles(camera.visibleMapRect(), camera.zoom);
+
+  // Pan and zoom only ever change these per-tile transforms
+  frameMatrices.clear();
+  for (GeometryTile *tile : frameTiles)
+    frameMatrices.append(camera.localMatrix(
+        tile->rect.topLeft(), tile->rect.width() / GeometryTiles::tileExtent));
+
+  program.bind();
+
+  profiler.begin(FrameProfiler::Buildings);
+  drawFills(camera.zoom, true);
+  profiler.end(FrameProfiler::Buildings);
+  profiler.begin(FrameProfiler::Polygons);
+  drawFills(camera.zoom, false);
+  profiler.end(FrameProfiler::Polygons);
+  program.release();
+
+  profiler.begin(FrameProfiler::Roads);
+  drawRoads(camera);
+  profiler.end(FrameProfiler::Roads);
+  profiler.begin(FrameProfiler::RoadLabels);
+  labels.draw(camera);
+  profiler.end(FrameProfiler::RoadLabels);
+}
+
+void MapRenderer::reportLevelStats() {
+  for (int level = 0; level < levelStats.size(); ++level) {
+    const LevelStats &stats = levelStats[level];
+    if (stats.frames == 0)
+      continue;
+    qDebug().nospace() << "Level " << level
+                       << (level < Graph::lodLevels ? " (simplified): "
+                                                    : " (full): ")
+                       << stats.frames << " frames, "
+                       << stats.nanos / 1e6 / stats.frames << " ms CPU, "
+                       << stats.indices / stats.frames << " indices/frame";
+  }
+
+  auto percent = [](qint64 hits, qint64 misses) {
+    return hits + misses > 0 ? 100.0 * hits / (hits + misses) : 0.0;
+  };
+  const GeometryTiles::PrefetchStats &tiles = geometryTiles.prefetchStats();
+  const LabelRenderer::PrefetchStats &layouts = labels.prefetchStats();
+  qDebug().nospace() << "Prefetch: tiles " << percent(tiles.hits, tiles.misses)
+                     << "% hit (" << tiles.hits << "/" << tiles.misses
+                     << " hit/miss, " << tiles.wasted << " wasted), labels "
+                     << percent(layouts.hits, layouts.misses) << "% hit ("
+                     << layouts.prefetched << " laid out ahead)";
+
+  const StreamingBuffer::Stats &upload = uploads.stats();
+  if (upload.frames > 0) {
+    qDebug().nospace() << "Uploads: " << upload.bytes / 1024.0 / upload.frames
+                       << " KB/frame, peak " << upload.peakFrameBytes / 1024.0
+                       << " KB, " << upload.streamed << "/" << upload.uploads
+                       << " through the ring, " << upload.stalls
+                       << " fence stalls";
+  }
+  uploads.resetStats();
+
+  levelStats.fill(LevelStats());
+  statsFrames = 0;
+}
+
+void MapRenderer::drawBackground() {
+  profiler.begin(FrameProfiler::Background);
+  QColor bgColor = backgroundColor();
+  glClearColor(bgColor.redF(), bgColor.greenF(), bgColor.blueF(), 1.0f);
+  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+  profiler.end(FrameProfiler::Background);
+}
+
+// Binds a tile's VAO, or its buffers plus attribute layout when the context
+// has no VAO support
+void MapRenderer::bindTile(GeometryTile *tile, bool roads) {
+  QOpenGLVertexArrayObject &vao = roads ? tile->roadVao : tile->fillVao;
+  if (vao.isCreated()) {
+    vao.bind();
+    return;
+  }
+  if (roads) {
+    tile->roadBuffer.bind();
+    GeometryTiles::setupRoadAttributes();
+    tile->roadIndexBuffer.bind();
+  } else {
+    tile->fillBuffer.bind();
+    GeometryTiles::setupVertexAttributes();
+    tile->fillIndexBuffer.bind();
+  }
+}
+
+void MapRenderer::releaseTile(GeometryTile *tile, bool roads) {
+  QOpenGLVertexArrayObject &vao = roads ? tile->roadVao : tile->fillVao;
+  if (vao.isCreated()) {
+    vao.release();
+    return;
+  }
+  if (roads)
+    glDisableVertexAttribArray(GeometryTiles::edgeAttribute);
+  QOpenGLBuffer::release(QOpenGLBuffer::VertexBuffer);
+  QOpenGLBuffer::release(QOpenGLBuffer::IndexBuffer);
+}
+
+// Each fill class is one indexed batch per tile over the cached triangles.
+// Classes hidden at this zoom are skipped without touching their geometry.
+// Buildings come first in every tile, then the area classes.
+void MapRenderer::drawFills(float zoom, bool buildings) {
+  if (frameTiles.isEmpty())
+    return;
+
+  const QVector<FillRange> &classes = frameTiles.first()->fillRanges;
+  for (int r = 0; r < classes.size(); ++r) {
+    if ((classes[r].cls == FeatureClass::Building) != buildings ||
+        !isVisibleAt(classes[r].cls, zoom))
+      continue;
+
+    for (int t = 0; t < frameTiles.size(); ++t) {
+      GeometryTile *tile = frameTiles[t];
+      const FillRange &range = tile->fillRanges[r];
+      if (range.count == 0)
+        continue;
+
+      program.setUniformValue(matrixLocation, frameMatrices[t]);
+      bindTile(tile, false);
+      glDrawElements(GL_TRIANGLES, range.count, GL_UNSIGNED_INT,
+                     reinterpret_cast<const void *>(range.first *
+                                                    sizeof(quint32)));
+      releaseTile(tile, false);
+      frameIndices += range.count;
+    }
+  }
+}
+
+void MapRenderer::drawRoads(const Camera &camera) {
+  if (frameTiles.isEmpty())
+    return;
+
+  glEnable(GL_DEPTH_TEST);
+  glDepthFunc(GL_LEQUAL);
+
+  // Visible tiles share one level, so one tile unit size
+  const double unit = frameTiles.first()->rect.width() / GeometryTiles::tileExtent;
+  roadProgram.bind();
+  roadProgram.setUniformValue("u_pixelSize", float(1.0 / (camera.zoom * unit)));
+  roadProgram.setUniformValue("u_extrudeRange", GeometryTiles::extrudeRange);
+
+  // Ranges are laid out identically in every tile (one per style class), so
+  // walk them class-major to keep layers stacked across tiles. Depth steps
+  // down per class: casing first, then fill.
+  const QVector<RoadRange> &classes = frameTiles.first()->roadRanges;
+  const float depthStep = 1.0f / (2 * classes.size() + 2);
+  for (int r = 0; r < classes.size(); ++r) {
+    if (!isVisibleAt(classes[r].cls, camera.zoom))
+      continue;
+    const RoadStyle &style = roadStyle(classes[r].cls);
+
+    roadProgram.setUniformValue("u_fillColor", style.fillColor);
+    roadProgram.setUniformValue("u_casingColor", style.casingColor);
+    roadProgram.setUniformValue("u_fillHalfWidth", style.width / 2);
+    roadProgram.setUniformValue("u_casingHalfWidth", style.casingWidth / 2);
+    roadProgram.setUniformValue("u_halfWidth", style.casingWidth / 2 + 1.0f);
+    roadProgram.setUniformValue("u_casingDepth", 1.0f - (2 * r + 1) * depthStep);
+    roadProgram.setUniformValue("u_fillDepth", 1.0f - (2 * r + 2) * depthStep);
+
+    for (int t = 0; t < frameTiles.size(); ++t) {
+      GeometryTile *tile = frameTiles[t];
+      const RoadRange &range = tile->roadRanges[r];
+      if (range.count == 0)
+        continue;
+
+      roadProgram.setUniformValue(roadMatrixLocation, frameMatrices[t]);
+      bindTile(tile, true);
+      glDrawElements(GL_TRIANGLES, range.count, GL_UNSIGNED_INT,
+                     reinterpret_cast<const void *>(range.first *
+                                                    sizeof(quint32)));
+      releaseTile(tile, true);
+      frameIndices += range.count;
+    }
+  }
+
+  roadProgram.release();
+  glDisable(GL_DEPTH_TEST);
+}
@@ -0,0 +1,84 @@
+#pragma once
+#include "camera.h"
+#include "frame_profiler.h"
+#include "geometry_tiles.h"
+#include "graph.h"
+#include "label_renderer.h"
+#include "raster_tile_cache.h"
+#include "streaming_buffer.h"
+#include <QOpenGLFunctions>
+#include <QOpenGLShaderProgram>
+
+// Shader-based renderer for the map layers. Geometry lives in the VBOs/VAOs
+// of GeometryTiles, in tile-local units, so a frame only updates each tile's
+// transform uniform and issues a few draw calls per visible tile. Works on
+// compatibility and core profiles as well as OpenGL ES.
+class MapRenderer : protected QOpenGLFunctions {
+public:
+  explicit MapRenderer(const Graph &graph);
+
+  void initialize(); // With the GL context current
+  void cleanup();    // Frees GL resources, context must be current
+  void invalidate(); // Graph changed, rebuild tiles on next frame
+  // Only features inside changed were added or edited: tiles, labels and
+  // cached raster tiles elsewhere are kept
+  void invalidate(const QRectF &changed);
+
+  // Composites cached raster tiles while the zoom holds still, renders the
+  // layers directly while it changes. devicePixelRatio is the bound
+  // framebuffer's, device pixels per camera viewport pixel.
+  void render(const Camera &camera, qreal devicePixelRatio = 1);
+  // Work finishing in the background (label layout) or over several frames
+  // (raster tiles) needs another frame
+  bool hasPendingWork() const {
+    return labels.isLayoutPending() || rasterCache.hasMissingTiles();
+  }
+
+  // Prepares tiles and labels of a predicted view on background threads,
+  // uploading a few finished tiles per call. After render, GL current.
+  void prefetch(const Camera &predicted);
+  void waitForPrefetch(); // Before the graph changes
+
+  // CPU frame time and indices drawn, averaged per quadtree level and
+  // logged every statsInterval frames
+  struct LevelStats {
+    int frames = 0;
+    qint64 nanos = 0;
+    qint64 indices = 0;
+  };
+  static constexpr int statsInterval = 300;
+
+  GeometryTiles &tiles() { return geometryTiles; }
+  RasterTileCache &rasterTiles() { return rasterCache; }
+  FrameProfiler &frameProfiler() { return profiler; }
+  StreamingBuffer &uploadBuffer() { return uploads; }
+
+  // Prepends the GLSL version line and compatibility macros for the current
+  // context (ATTRIBUTE/VARYING, FRAG_COLOR and TEXTURE in fragment shaders)
+  static QByteArray shaderSource(const char *body, bool vertexShader);
+
+private:
+  void renderLayers(const Camera &camera);
+  void drawBackground();
+  void drawFills(float zoom, bool buildings);
+  void drawRoads(const Camera &camera);
+  void bindTile(GeometryTile *tile, bool roads);
+  void releaseTile(GeometryTile *tile, bool roads);
+  void reportLevelStats();
+
+  GeometryTiles geometryTiles;
+  LabelRenderer labels; // Road names
+  RasterTileCache rasterCache;
+  FrameProfiler profiler;
+  StreamingBuffer uploads; // Staging ring for tile uploads
+  float lastZoom = 0.0f;
+  QVector<GeometryTile *> frameTiles; // Tiles drawn in the current frame
+  QVector<QMatrix4x4> frameMatrices;  // Camera transform of each frame tile
+  QOpenGLShaderProgram program; // Building and polygon fills
+  int matrixLocation = -1;
+  QOpenGLShaderProgram roadProgram;
+  int roadMatrixLocation = -1;
+  QVector<LevelStats> levelStats{GeometryTiles::maxLevel + 1};
+  int statsFrames = 0;
+  qint64 frameIndices = 0; // Summed over every layer pass of a frame
+};
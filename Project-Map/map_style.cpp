@@ -0,0 +1,46 @@
+#include "map_style.h"
+
+namespace {
+
+const QColor footwayFill(120, 200, 120);
+const QColor footwayCasing(50, 100, 50);
+const QColor minorFill("#FFFFFF");   // White fill
+const QColor minorCasing("#4A4A4A"); // Dark gray border
+
+// Indexed by road class, bottom to top
+const RoadStyle roadStyles[roadClassCount] = {
+    {footwayFill, footwayCasing, 1.0f, 1.8f},           // Footway
+    {footwayFill, footwayCasing, 1.0f, 1.8f},           // Path
+    {minorFill, minorCasing, 1.9f, 2.0f},               // Service
+    {minorFill, minorCasing, 1.9f, 2.0f},               // Residential
+    {minorFill, minorCasing, 1.9f, 2.0f},               // Unclassified
+    {QColor(255, 220, 120), Qt::black, 6.0f, 7.5f},     // Tertiary
+    {QColor(255, 220, 120), Qt::black, 6.0f, 7.0f},     // Secondary
+    {QColor(255, 165, 0), Qt::black, 6.0f, 7.0f},       // Trunk
+    {QColor(255, 165, 0), Qt::black, 6.0f, 7.0f},       // Primary
+    {QColor(255, 165, 0), Qt::black, 6.0f, 7.0f},       // Highway
+    {QColor(255, 208, 0), Qt::black, 6.0f, 7.0f},       // Motorway
+};
+
+} // namespace
+
+QColor backgroundColor() { return QColor("#E0DFDF"); }
+
+const RoadStyle &roadStyle(FeatureClass cls) { return roadStyles[int(cls)]; }
+
+QColor areaColor(FeatureClass cls) {
+  switch (cls) {
+  case FeatureClass::Building:
+    return QColor::fromRgbF(0.6f, 0.6f, 0.8f);
+  case FeatureClass::Grass:
+    return QColor::fromRgbF(0.8f, 1.0f, 0.8f); // green
+  case FeatureClass::Forest:
+    return QColor::fromRgbF(0.5f, 0.8f, 0.5f); // darker green
+  case FeatureClass::Cemetery:
+    return QColor::fromRgbF(0.9f, 0.9f, 0.7f);
+  case FeatureClass::ResidentialArea:
+    return QColor::fromRgbF(0.95f, 0.95f, 0.9f);
+  default:
+    return QColor::fromRgbF(0.85f, 0.85f, 0.85f); // default gray
+  }
+}
@@ -0,0 +1,20 @@
+#pragma once
+#include "feature_rules.h"
+#include <QColor>
+
+// Resolved drawing style of a road class. Widths are in pixels.
+struct RoadStyle {
+  QColor fillColor;
+  QColor casingColor;
+  float width;       // Fill
+  float casingWidth; // Outer width including the casing
+};
+
+// cls must be a road class (below roadClassCount)
+const RoadStyle &roadStyle(FeatureClass cls);
+
+// Clear color behind everything
+QColor backgroundColor();
+
+// Fill color of buildings and landuse/leisure classes
+QColor areaColor(FeatureClass cls);
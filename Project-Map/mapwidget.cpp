@@ -1,18 +1,34 @@
 #include "mapwidget.h"
+#include "feature_rules.h"
+#include "map_style.h"
 #include <QDebug>
+#include <QElapsedTimer>
 #include <QOpenGLFunctions>
 #include <QPainter>
 #include <algorithm>
 #include <cmath>
+#include <cstddef>
 
 MapWidget::MapWidget(QWidget *parent) : QOpenGLWidget(parent) {
   setMouseTracking(true);
+  setFocusPolicy(Qt::StrongFocus); // F3/F4 for the profiler
+  scheduler = new FrameScheduler(this);
+  renderThread = new RenderThread(graph, this);
+  connect(renderThread, &RenderThread::frameReady, scheduler,
+          &FrameScheduler::requestFrame);
   loader = new OSMLoader(graph, this);
   net = new NetworkManager(this);
 
   connect(net, &NetworkManager::dataReceived, this,
           [=](const QByteArray &data) {
-            loader->loadAreasFromJSON(data);
+            bool firstLoad = false;
+            renderThread->modifyGraph([&] {
+              std::optional<QRectF> changed = loader->loadAreasFromJSON(data);
+              firstLoad = !changed;
+              return changed;
+            });
+            areaNames.invalidate();
+            hovered = PickResult();
             qDebug() << "Total roads:" << graph.roads.size();
 
             qDebug() << "Area label size:" << graph.areaLabels.size();
@@ -20,6 +36,12 @@ MapWidget::MapWidget(QWidget *parent) : QOpenGLWidget(parent) {
             //   qDebug() << "Label:" << QString::fromStdString(label.name);
             // }
 
+            // Later loads only add to the map, the view stays where it is
+            if (!firstLoad) {
+              scheduler->requestFrame();
+              return;
+            }
+
             mapWidth = (graph.maxLon - graph.minLon) * graph.scale;
             mapHeight = (graph.maxLat - graph.minLat) * graph.scale;
 
@@ -32,7 +54,7 @@ MapWidget::MapWidget(QWidget *parent) : QOpenGLWidget(parent) {
             panX = -centerX + width() / (2.0f * zoom);
             panY = -centerY + height() / (2.0f * zoom);
 
-            update();
+            scheduler->requestFrame();
           });
 
   double south = 32.09;
@@ -66,264 +88,131 @@ out skel qt;
   net->fetchOverpassData(query);
 }
 
-void MapWidget::initializeGL() {
-  glMatrixMode(GL_MODELVIEW);
-  initializeOpenGLFunctions();
-  glClearColor(1, 1, 1, 1); // White background
-
-  glMatrixMode(GL_PROJECTION);
-  glLoadIdentity();
-  glOrtho(-width() / 2, width() / 2, -height() / 2, height() / 2, -1, 1);
-
-  glMatrixMode(GL_MODELVIEW);
-  glLoadIdentity();
+MapWidget::~MapWidget() {
+  // The render thread's context shares objects with ours, stop it first
+  renderThread->stopRendering();
+  makeCurrent();
+  blitter.destroy();
+  doneCurrent();
 }
 
-void MapWidget::paintGL() {
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    glMatrixMode(GL_MODELVIEW);
-    glLoadIdentity();
-
-    // Set background color
-    QColor bgColor("#E0DFDF");
-    glColor3f(bgColor.redF(), bgColor.greenF(), bgColor.blueF());
-    glBegin(GL_QUADS);
-    glVertex2f(-width(), -height());
-    glVertex2f(width(), -height());
-    glVertex2f(width(), height());
-    glVertex2f(-width(), height());
-    glEnd();
-
-    // ✅ Tell Qt we're doing OpenGL manually
-    QPainter painter(this);
-    painter.beginNativePainting();   // <-- Important!
-
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-
-    glScalef(zoom, zoom, 1.0f);
-    glTranslatef(panX, panY, 0);
-
-    drawBuildings();
-    drawPolygons();
-    drawRoads();
-
-    glFlush();
-
-    painter.endNativePainting();     // <-- Restore Qt state after OpenGL
-
-    // ✅ Now safe to draw labels, text, etc. using QPainter
-    painter.setRenderHint(QPainter::Antialiasing);
-    painter.setRenderHint(QPainter::TextAntialiasing);
-
-    QTransform transform;
-    transform.translate(width() / 2.0, height() / 2.0);
-    transform.scale(zoom, -zoom);
-    transform.translate(panX, panY);
-    painter.setTransform(transform);
-
-    drawAreaNames(painter);
-    drawRoadNames(painter);
+void MapWidget::initializeGL() {
+  blitter.create();
+  renderThread->startRendering(context());
 }
 
-
-void MapWidget::drawRoads() {
-  QStringList layerOrder = {"footway",     "path",         "service",
-                            "residential", "unclassified", "tertiary",
-                            "secondary",   "trunk",        "primary",
-                            "highway",     "motorway"};
-
-  for (const QString &layerType : layerOrder) {
-    for (const Road &road : graph.roads) {
-      if (road.nodes.size() < 2)
-        continue;
-
-      if (road.type != layerType)
-        continue;
-
-      QColor baseColor = Qt::black;
-      QColor borderColor = Qt::black;
-      float width = 1.0f;
-      float borderWidth = 1.2f;
-      float opacity = 1.0f;
-      const QString &type = road.type;
-
-      // Assign colors & sizes based on type (same as your current logic)
-      if (type == "motorway") {
-        baseColor = QColor(255, 208, 0);
-        borderColor = QColor(0, 0, 0);
-        width = 6.0f;
-        borderWidth = 7.0f;
-
-      } else if (type == "primary" || type == "highway") {
-        baseColor = QColor(255, 165, 0);
-        borderColor = QColor(0, 0, 0);
-        width = 6.0f;
-        borderWidth = 7.0f;
-      } else if (type == "secondary") {
-        baseColor = QColor(255, 220, 120);
-        borderColor = QColor(0, 0, 0);
-        width = 6.0f;
-        borderWidth = 7.0f;
-      } else if (type == "tertiary") {
-        baseColor = QColor(255, 220, 120);
-        borderColor = QColor(0, 0, 0);
-        width = 6.0f;
-        borderWidth = 7.5f;
-      } else if (type == "trunk") {
-        baseColor = QColor(255, 165, 0);
-        borderColor = QColor(0, 0, 0);
-        width = 6.0f;
-        borderWidth = 7.0f;
-
-      } else if (type == "residential" || type == "unclassified" ||
-                 type == "service") {
-
-        baseColor = QColor("#FFFFFF");   // Light gray fill
-        borderColor = QColor("#4A4A4A"); // Dark gray border
-
-        width = 1.9f;
-        borderWidth = 2.0f;
-      } else if (type == "footway" || type == "path") {
-        baseColor = QColor(120, 200, 120, 140);
-        borderColor = QColor(50, 100, 50);
-        width = 1.0f;
-        borderWidth = 1.8f;
-      }
-
-      // Border Pass
-      glColor4f(borderColor.redF(), borderColor.greenF(), borderColor.blueF(),
-                opacity);
-      glLineWidth(borderWidth);
-      glBegin(GL_LINE_STRIP);
-      for (const QPointF &pt : road.nodes)
-        glVertex2f(pt.x(), pt.y());
-      glEnd();
-
-      // Main Road Pass
-      glColor4f(baseColor.redF(), baseColor.greenF(), baseColor.blueF(),
-                opacity);
-      glLineWidth(width);
-      glBegin(GL_LINE_STRIP);
-      for (const QPointF &pt : road.nodes)
-        glVertex2f(pt.x(), pt.y());
-      glEnd();
-
-      for (const QPointF &pt : road.nodes) {
-        glVertex2f(pt.x(), pt.y());
-      }
-      glEnd();
-    }
+// Shows the newest frame of the render thread and asks it for the current
+// view. Only the hover outline and area names are painted here, in the
+// camera of the frame they go on.
+void MapWidget::paintGL() {
+  applyInput(scheduler->takeInput());
+
+  RenderThread::FrameRequest request;
+  request.camera = camera();
+  request.predicted = scheduler->predict(request.camera, prefetchLookahead);
+  request.devicePixelRatio = devicePixelRatioF();
+  request.showProfiler = showProfiler;
+  request.areaLabelNanos = areaLabelNanos;
+  renderThread->requestFrame(request);
+
+  const RenderThread::Frame frame = renderThread->takeFrame();
+  if (frame.texture == 0) {
+    // Nothing rendered yet
+    const QColor bgColor = backgroundColor();
+    QOpenGLFunctions *gl = context()->functions();
+    gl->glClearColor(bgColor.redF(), bgColor.greenF(), bgColor.blueF(), 1.0f);
+    gl->glClear(GL_COLOR_BUFFER_BIT);
+    return;
   }
-}
-
-void MapWidget::drawRoadNames(QPainter &painter) {
-  QFont font = painter.font();
-  font.setPointSizeF(1.0); // Scale with map zoom externally
-  painter.setFont(font);
-  painter.setPen(Qt::black);
-
-  for (const Road &road : graph.roads) {
-    if (road.name.isEmpty() || road.nodes.size() < 2)
-      continue;
-
-    const QString &name = road.name;
-    const QVector<QPointF> &nodes = road.nodes;
-
-    QFontMetricsF fm(font);
-
-    // Compute road length
-    QVector<float> segmentLengths;
-    float totalLength = 0.0f;
-    for (int i = 1; i < nodes.size(); ++i) {
-      float len = QLineF(nodes[i - 1], nodes[i]).length();
-      segmentLengths.push_back(len);
-      totalLength += len;
-    }
-
-    // Total text width
-    float textLength = 0.0f;
-    for (QChar ch : name)
-      textLength += fm.horizontalAdvance(ch);
-
-    // Skip drawing if text is longer than the road
-    if (textLength >= totalLength)
-      continue;
 
-    // Center the text
-    float offset = (totalLength - textLength) / 2.0f;
-    float currentOffset = 0.0f;
-
-    int segIndex = 0;
-    float segPos = 0.0f;
-
-    for (int i = 0; i < name.size(); ++i) {
-      QChar ch = name[i];
-      float charWidth = fm.horizontalAdvance(ch);
-
-      float charMidOffset = offset + currentOffset + charWidth / 2;
-
-      // Move to segment where this character's center lies
-      while (segIndex < segmentLengths.size() &&
-             segPos + segmentLengths[segIndex] < charMidOffset) {
-        segPos += segmentLengths[segIndex++];
-      }
-
-      if (segIndex >= nodes.size() - 1)
-        break;
-
-      QPointF p1 = nodes[segIndex];
-      QPointF p2 = nodes[segIndex + 1];
-      float segLength = segmentLengths[segIndex];
-
-      float t = (charMidOffset - segPos) / segLength;
-      QPointF pos = p1 + (p2 - p1) * t;
-
-      float angle = std::atan2(p2.y() - p1.y(), p2.x() - p1.x()) * 180.0 / M_PI;
-
-      painter.save();
-      painter.translate(pos);
-      painter.rotate(angle);
-      painter.scale(1.0, -1.0); // Flip for OpenGL-compatible coordinate system
-      painter.drawText(QPointF(-charWidth / 2.0, 0), QString(ch));
-      painter.restore();
-
-      currentOffset += charWidth;
-    }
-  }
+  QPainter painter(this);
+  painter.beginNativePainting();
+  const QRect viewport(QPoint(), size() * devicePixelRatioF());
+  blitter.bind();
+  blitter.blit(frame.texture,
+               QOpenGLTextureBlitter::targetTransform(
+                   QRectF(QPointF(), QSizeF(frame.size)), viewport),
+               QOpenGLTextureBlitter::OriginBottomLeft);
+  blitter.release();
+  renderThread->frameShown();
+  painter.endNativePainting();
+
+  painter.setRenderHint(QPainter::Antialiasing);
+  painter.setRenderHint(QPainter::TextAntialiasing);
+
+  const Camera &view = frame.camera;
+  QTransform transform;
+  transform.translate(view.viewport.width() / 2.0,
+                      view.viewport.height() / 2.0);
+  transform.scale(view.zoom, -view.zoom);
+  transform.translate(view.panX, view.panY);
+  painter.setTransform(transform);
+
+  drawHighlight(painter);
+  QElapsedTimer timer;
+  timer.start();
+  drawAreaNames(painter, view);
+  areaLabelNanos = timer.nsecsElapsed();
 }
 
+// Map units, as Graph::normalizeCoordinates places the features
 QPointF MapWidget::projectLonLat(double lon, double lat) {
-  // You should use the same projection params as the rest of your map.
-  double x = lon * 111320.0; // Approx meters per degree longitude
-  double y = lat * 110540.0; // Approx meters per degree latitude
+  double x = (lon - graph.minLon) * graph.scale;
+  double y = (lat - graph.maxLat) * graph.scale;
   return QPointF(x, y);
 }
 
-void MapWidget::drawAreaNames(QPainter &painter) {
-  for (const AreaLabel &label : graph.areaLabels) {
-    if (zoom > 2.0)
-      continue;
+void MapWidget::drawAreaNames(QPainter &painter, const Camera &view) {
+  areaNames.draw(painter, view, graph.areaLabels,
+                 [this](const QPointF &lonLat) {
+                   return projectLonLat(lonLat.x(), lonLat.y());
+                 });
+}
+
+Camera MapWidget::camera() const {
+  Camera cam;
+  cam.zoom = zoom;
+  cam.panX = panX;
+  cam.panY = panY;
+  cam.viewport = size();
+  return cam;
+}
+
+QRectF MapWidget::visibleMapRect() const { return camera().visibleMapRect(); }
 
-    QPointF pt = projectLonLat(label.center.x(), label.center.y());
+QPointF MapWidget::screenToMap(const QPointF &widgetPos) const {
+  double sx = widgetPos.x() - width() / 2.0;
+  double sy = height() / 2.0 - widgetPos.y(); // Y is flipped
+  return QPointF(sx / zoom - panX, sy / zoom - panY);
+}
 
-    QFont font = painter.font();
-    font.setPointSizeF(label.isMajor ? std::clamp(zoom * 10.0f, 8.0f, 30.0f)
-                                     : std::clamp(zoom * 6.0f, 6.0f, 18.0f));
-    font.setBold(label.isMajor);
-    painter.setFont(font);
+PickResult MapWidget::pickAt(const QPointF &widgetPos) const {
+  const double tolerancePx = 4.0;
+  return pickFeature(graph, screenToMap(widgetPos), tolerancePx / zoom);
+}
 
-    QString name = QString::fromStdString(label.name);
-    QFontMetricsF fm(font);
-    QRectF textRect = fm.boundingRect(name);
-    QPointF centerPt = pt - QPointF(textRect.width() / 2, -fm.ascent() / 2);
+// Outlines the hovered feature on top of the map, in map coordinates
+void MapWidget::drawHighlight(QPainter &painter) {
+  if (hovered.kind == PickResult::None)
+    return;
 
-    painter.setPen(QPen(Qt::white, 3.0));
-    painter.drawText(centerPt, name);
+  QPen pen(QColor(220, 40, 40), 2.5);
+  pen.setCosmetic(true); // Width in pixels regardless of zoom
+  painter.setPen(pen);
+  painter.setBrush(Qt::NoBrush);
 
-    painter.setPen(Qt::black);
-    painter.drawText(centerPt, name);
+  if (hovered.kind == PickResult::Road) {
+    const Road &road = graph.roads[hovered.index];
+    painter.drawPolyline(road.nodes.constData(), road.nodes.size());
+    return;
   }
+
+  const PolygonArea &area = hovered.kind == PickResult::Building
+                                ? graph.buildings[hovered.index]
+                                : graph.polygons[hovered.index];
+  painter.drawPolygon(area.nodes.constData(), area.nodes.size());
+  for (const auto &hole : area.holes)
+    painter.drawPolygon(hole.constData(), hole.size());
 }
 
 QPointF MapWidget::mapToScreen(const QPointF &geo) {
@@ -335,86 +224,50 @@ QPointF MapWidget::mapToScreen(const QPointF &geo) {
   return pt;
 }
 
-void MapWidget::drawPolygons() {
-  for (const auto &poly : graph.polygons) {
-    if (poly.nodes.size() < 3)
-      continue;
-
-    // Determine polygon type
-    QString type = poly.tags.value("landuse", poly.tags.value("leisure"));
-
-    // Set color based on type
-    if (type == "grass" || type == "meadow")
-      glColor3f(0.8f, 1.0f, 0.8f); // green
-    else if (type == "forest")
-      glColor3f(0.5f, 0.8f, 0.5f); // darker green
-    else if (type == "cemetery")
-      glColor3f(0.9f, 0.9f, 0.7f);
-    else if (type == "residential")
-      glColor3f(0.95f, 0.95f, 0.9f);
-    else
-      glColor3f(0.85f, 0.85f, 0.85f); // default gray
-
-    glBegin(GL_POLYGON);
-    for (const auto &pt : poly.nodes)
-      glVertex2f(pt.x(), pt.y());
-    glEnd();
+// F3 toggles the frame profiler overlay, F4 writes its history to CSV
+void MapWidget::keyPressEvent(QKeyEvent *event) {
+  if (event->key() == Qt::Key_F3) {
+    showProfiler = !showProfiler;
+    scheduler->requestFrame();
+  } else if (event->key() == Qt::Key_F4) {
+    renderThread->exportProfile("frame_profile.csv");
+  } else {
+    QOpenGLWidget::keyPressEvent(event);
   }
 }
 
-void MapWidget::resizeGL(int w, int h) {
-  glViewport(0, 0, w, h);
-  glMatrixMode(GL_PROJECTION);
-  glLoadIdentity();
-  glOrtho(-w / 2, w / 2, -h / 2, h / 2, -1, 1);
-  glMatrixMode(GL_MODELVIEW);
-  glLoadIdentity();
+void MapWidget::wheelEvent(QWheelEvent *event) {
+  QPoint numDegrees = event->angleDelta() / 8;
+  float zoomFactor = 1.0f + numDegrees.y() / 240.0f;
+  scheduler->addZoom(zoomFactor, event->position());
 }
 
-void MapWidget::drawBuildings() {
-  glColor3f(0.6f, 0.6f, 0.8f); // Light bluish-gray for buildings
-
-  for (const auto &building : graph.buildings) {
-    if (building.nodes.size() < 3)
-      continue; // Not a valid polygon
+// Input collected by the scheduler since the last frame, applied once
+void MapWidget::applyInput(const FrameScheduler::Input &input) {
+  if (input.zoomFactor != 1.0) {
+    float oldZoom = zoom;
+    zoom = std::clamp(float(zoom * input.zoomFactor), 0.9f, 60.0f);
 
-    glBegin(GL_POLYGON);
-    for (const auto &pt : building.nodes) {
-      glVertex2f(pt.x(), pt.y());
-    }
-    glEnd();
-  }
-}
+    // Adjust pan to zoom at mouse position
+    float mx = input.zoomAnchor.x() - width() / 2.0f;
+    float my = height() / 2.0f - input.zoomAnchor.y(); // Y is flipped
 
-void MapWidget::drawBackground() {
-  glColor3f(0.2f, 0.6f, 0.8f); // light blue grid
-  glBegin(GL_LINES);
-  for (int i = -1000; i <= 1000; i += 100) {
-    glVertex2f(i, -1000);
-    glVertex2f(i, 1000);
-    glVertex2f(-1000, i);
-    glVertex2f(1000, i);
+    panX -= mx * (1.0f / oldZoom - 1.0f / zoom);
+    panY -= my * (1.0f / oldZoom - 1.0f / zoom);
   }
-  glEnd();
-}
-
-void MapWidget::wheelEvent(QWheelEvent *event) {
-  float oldZoom = zoom;
-  QPoint numDegrees = event->angleDelta() / 8;
-  float zoomFactor = 1.0f + numDegrees.y() / 240.0f;
-  zoom *= zoomFactor;
-
-  // Clamp zoom
-  zoom = std::clamp(zoom, 0.9f, 60.0f);
 
-  // Adjust pan to zoom at mouse position
-  float mx = event->position().x() - width() / 2.0f;
-  float my = height() / 2.0f - event->position().y(); // Y is flipped
+  if (!input.pan.isNull()) {
+    panX += input.pan.x() / zoom;
+    panY -= input.pan.y() / zoom; // Y flipped in OpenGL
 
-  panX -= mx * (1.0f / oldZoom - 1.0f / zoom);
-  panY -= my * (1.0f / oldZoom - 1.0f / zoom);
+    float minX = -mapWidth;
+    float maxX = mapWidth - 555.416f;
+    float minY = -mapHeight + 1050.416f;
+    float maxY = mapHeight;
 
-  update();
+    panX = std::clamp(panX, minX, maxX);
+    panY = std::clamp(panY, minY, maxY);
+  }
 }
 
 void MapWidget::mousePressEvent(QMouseEvent *event) {
@@ -434,19 +287,15 @@ void MapWidget::mouseReleaseEvent(QMouseEvent *event) {
 
 void MapWidget::mouseMoveEvent(QMouseEvent *event) {
   if (isDragging) {
-    QPointF delta = event->pos() - lastMousePos;
-    panX += delta.x() / zoom;
-    panY -= delta.y() / zoom; // Y flipped in OpenGL
-
-    float minX = -mapWidth;
-    float maxX = mapWidth - 555.416f;
-    float minY = -mapHeight + 1050.416f;
-    float maxY = mapHeight;
-
-    panX = std::clamp(panX, minX, maxX);
-    panY = std::clamp(panY, minY, maxY);
-
-    update();
+    scheduler->addPan(event->pos() - lastMousePos);
     lastMousePos = event->pos();
+    return;
+  }
+
+  PickResult pick = pickAt(event->position());
+  if (pick != hovered) {
+    hovered = pick;
+    emit hoveredFeatureChanged(hovered);
+    scheduler->requestFrame();
   }
 }
@@ -1,40 +1,57 @@
 #pragma once
 
+#include "area_label_cache.h"
+#include "camera.h"
+#include "feature_picker.h"
+#include "frame_scheduler.h"
 #include "graph.h"
 #include "network_manager.h"
 #include "osm_loader.h"
+#include "render_thread.h"
+#include <QKeyEvent>
 #include <QMouseEvent>
-#include <QOpenGLFunctions>
+#include <QOpenGLTextureBlitter>
 #include <QOpenGLWidget>
 #include <QWheelEvent>
 
-class MapWidget : public QOpenGLWidget, protected QOpenGLFunctions {
+class MapWidget : public QOpenGLWidget {
   Q_OBJECT
 
 public:
   MapWidget(QWidget *parent = nullptr);
+  ~MapWidget();
+
+  // Feature under a widget position, in microseconds via the R-trees
+  PickResult pickAt(const QPointF &widgetPos) const;
+  QPointF screenToMap(const QPointF &widgetPos) const;
+  const PickResult &hoveredFeature() const { return hovered; }
+
+signals:
+  void hoveredFeatureChanged(const PickResult &pick);
 
 protected:
   void initializeGL() override;
-  void resizeGL(int w, int h) override;
   void paintGL() override;
 
-  void drawRoads();
-  void drawPolygons();
-  void drawBuildings();
+  void keyPressEvent(QKeyEvent *event) override;
   void wheelEvent(QWheelEvent *event) override;
   void mousePressEvent(QMouseEvent *event) override;
   void mouseReleaseEvent(QMouseEvent *event) override;
   void mouseMoveEvent(QMouseEvent *event) override;
-  void drawRoadNames(QPainter &painter);
-  void drawAreaNames(QPainter &painter);
+  void drawAreaNames(QPainter &painter, const Camera &view);
+  void drawHighlight(QPainter &painter);
   QPointF mapToScreen(const QPointF &geo);
   QPointF projectLonLat(double lon, double lat);
+  void applyInput(const FrameScheduler::Input &input);
+  Camera camera() const;
+  QRectF visibleMapRect() const;
 
 private:
   Graph graph;
   OSMLoader *loader;
   NetworkManager *net;
+  FrameScheduler *scheduler;
+  RenderThread *renderThread;
   float zoom = 1.0f;
   float panX = 0, panY = 0;
   QPoint lastMousePos;
@@ -42,5 +59,11 @@ private:
   Qt::MouseButton dragButton;
   float mapWidth = 0;
   float mapHeight = 0;
-  void drawBackground();
+  QOpenGLTextureBlitter blitter; // Render thread frames to the screen
+  AreaLabelCache areaNames;
+  PickResult hovered;
+  bool showProfiler = false;
+  qint64 areaLabelNanos = 0; // Last drawAreaNames, for the profiler
+  // Seconds of current motion to prepare tiles and labels for
+  static constexpr double prefetchLookahead = 0.3;
 };
@@ -0,0 +1,453 @@
+#include "mvt_encoder.h"
+#include <QHash>
+#include <QPoint>
+#include <QPolygonF>
+#include <QTransform>
+#include <algorithm>
+
+namespace {
+
+// Minimal protobuf writer, only the wire types MVT uses
+class ProtoWriter {
+public:
+  enum WireType { Varint = 0, LengthDelimited = 2 };
+
+  void varint(quint64 value) {
+    while (value >= 0x80) {
+      data.append(char((value & 0x7f) | 0x80));
+      value >>= 7;
+    }
+    data.append(char(value));
+  }
+  void key(int field, WireType type) { varint(quint64(field) << 3 | type); }
+  void uint(int field, quint64 value) {
+    key(field, Varint);
+    varint(value);
+  }
+  void bytes(int field, const QByteArray &value) {
+    key(field, LengthDelimited);
+    varint(value.size());
+    data += value;
+  }
+  void packed(int field, const QVector<quint32> &values) {
+    ProtoWriter inner;
+    for (quint32 v : values)
+      inner.varint(v);
+    bytes(field, inner.data);
+  }
+
+  QByteArray data;
+};
+
+// Field numbers and enums of vector_tile.proto
+enum GeomType { Point = 1, LineString = 2, Polygon = 3 };
+enum Command { MoveTo = 1, LineTo = 2, ClosePath = 7 };
+
+quint32 command(Command id, int count) { return quint32(id) | count << 3; }
+quint32 zigzag(int v) { return (quint32(v) << 1) ^ quint32(v >> 31); }
+
+// Command stream of one feature, deltas relative to the previous point
+class GeometryEncoder {
+public:
+  void addPoint(const QPoint &p) {
+    commands.append(command(MoveTo, 1));
+    append(p);
+  }
+  void addLine(const QVector<QPoint> &points) {
+    commands.append(command(MoveTo, 1));
+    append(points.first());
+    commands.append(command(LineTo, points.size() - 1));
+    for (int i = 1; i < points.size(); ++i)
+      append(points[i]);
+  }
+  // Ring without the repeated first point
+  void addRing(const QVector<QPoint> &points) {
+    addLine(points);
+    commands.append(command(ClosePath, 1));
+  }
+
+  QVector<quint32> commands;
+
+private:
+  void append(const QPoint &p) {
+    commands.append(zigzag(p.x() - cursor.x()));
+    commands.append(zigzag(p.y() - cursor.y()));
+    cursor = p;
+  }
+
+  QPoint cursor;
+};
+
+// One layer with its deduplicated key and value tables
+class LayerBuilder {
+public:
+  LayerBuilder(const char *name, int extent) : name(name), extent(extent) {}
+
+  using Tags = QVector<QPair<QString, QByteArray>>; // Key, encoded Value
+
+  static QByteArray stringValue(const QString &s) {
+    ProtoWriter value;
+    value.bytes(1, s.toUtf8());
+    return value.data;
+  }
+  static QByteArray boolValue(bool b) {
+    ProtoWriter value;
+    value.uint(7, b);
+    return value.data;
+  }
+
+  void addFeature(quint64 id, GeomType type, const Tags &tags,
+                  const QVector<quint32> &geometry) {
+    QVector<quint32> tagIndices;
+    for (const auto &tag : tags) {
+      tagIndices.append(intern(keyIndex, keys, tag.first.toUtf8()));
+      tagIndices.append(intern(valueIndex, values, tag.second));
+    }
+
+    ProtoWriter feature;
+    feature.uint(1, id);
+    if (!tagIndices.isEmpty())
+      feature.packed(2, tagIndices);
+    feature.uint(3, type);
+    feature.packed(4, geometry);
+    features.bytes(2, feature.data);
+    ++featureCount;
+  }
+
+  bool isEmpty() const { return featureCount == 0; }
+
+  QByteArray encode() const {
+    ProtoWriter layer;
+    layer.uint(15, 2); // Version
+    layer.bytes(1, name);
+    layer.data += features.data;
+    for (const QByteArray &k : keys)
+      layer.bytes(3, k);
+    for (const QByteArray &v : values)
+      layer.bytes(4, v);
+    layer.uint(5, extent);
+    return layer.data;
+  }
+
+private:
+  static int intern(QHash<QByteArray, int> &index, QVector<QByteArray> &table,
+                    const QByteArray &entry) {
+    auto it = index.constFind(entry);
+    if (it != index.constEnd())
+      return it.value();
+    table.append(entry);
+    index.insert(entry, table.size() - 1);
+    return table.size() - 1;
+  }
+
+  QByteArray name;
+  int extent;
+  ProtoWriter features; // Already framed as field 2
+  int featureCount = 0;
+  QVector<QByteArray> keys;
+  QVector<QByteArray> values;
+  QHash<QByteArray, int> keyIndex;
+  QHash<QByteArray, int> valueIndex;
+};
+
+// Liang-Barsky: clips segment a-b to rect, false when nothing is left
+bool clipSegment(QPointF &a, QPointF &b, const QRectF &rect) {
+  const double dx = b.x() - a.x();
+  const double dy = b.y() - a.y();
+  const double p[4] = {-dx, dx, -dy, dy};
+  const double q[4] = {a.x() - rect.left(), rect.right() - a.x(),
+                       a.y() - rect.top(), rect.bottom() - a.y()};
+  double t0 = 0.0, t1 = 1.0;
+  for (int i = 0; i < 4; ++i) {
+    if (p[i] == 0.0) {
+      if (q[i] < 0.0)
+        return false; // Parallel and outside
+      continue;
+    }
+    const double t = q[i] / p[i];
+    if (p[i] < 0.0)
+      t0 = std::max(t0, t);
+    else
+      t1 = std::min(t1, t);
+  }
+  if (t0 > t1)
+    return false;
+
+  const QPointF start = a;
+  if (t1 < 1.0)
+    b = start + QPointF(dx, dy) * t1;
+  if (t0 > 0.0)
+    a = start + QPointF(dx, dy) * t0;
+  return true;
+}
+
+// Parts of a polyline inside rect; leaving and re-entering starts a new part
+QVector<QPolygonF> clipPolyline(const QPolygonF &line, const QRectF &rect) {
+  QVector<QPolygonF> parts;
+  QPolygonF current;
+  for (int i = 1; i < line.size(); ++i) {
+    QPointF a = line[i - 1];
+    QPointF b = line[i];
+    if (!clipSegment(a, b, rect)) {
+      if (!current.isEmpty())
+        parts.append(current);
+      current.clear();
+      continue;
+    }
+
+    if (current.isEmpty() || current.last() != a) {
+      if (!current.isEmpty())
+        parts.append(current);
+      current = QPolygonF({a});
+    }
+    current.append(b);
+    if (b != line[i]) { // Left the rect
+      parts.append(current);
+      current.clear();
+    }
+  }
+  if (!current.isEmpty())
+    parts.append(current);
+  return parts;
+}
+
+// Sutherland-Hodgman against each edge of rect in turn
+QPolygonF clipRing(const QPolygonF &ring, const QRectF &rect) {
+  QPolygonF out = ring;
+  for (int edge = 0; edge < 4 && !out.isEmpty(); ++edge) {
+    auto inside = [&](const QPointF &p) {
+      switch (edge) {
+      case 0: return p.x() >= rect.left();
+      case 1: return p.x() <= rect.right();
+      case 2: return p.y() >= rect.top();
+      default: return p.y() <= rect.bottom();
+      }
+    };
+    auto intersect = [&](const QPointF &a, const QPointF &b) {
+      double t;
+      switch (edge) {
+      case 0: t = (rect.left() - a.x()) / (b.x() - a.x()); break;
+      case 1: t = (rect.right() - a.x()) / (b.x() - a.x()); break;
+      case 2: t = (rect.top() - a.y()) / (b.y() - a.y()); break;
+      default: t = (rect.bottom() - a.y()) / (b.y() - a.y()); break;
+      }
+      return a + (b - a) * t;
+    };
+
+    const QPolygonF in = out;
+    out.clear();
+    for (int i = 0; i < in.size(); ++i) {
+      const QPointF &cur = in[i];
+      const QPointF &prev = in[(i + in.size() - 1) % in.size()];
+      if (inside(cur)) {
+        if (!inside(prev))
+          out.append(intersect(prev, cur));
+        out.append(cur);
+      } else if (inside(prev)) {
+        out.append(intersect(prev, cur));
+      }
+    }
+  }
+  return out;
+}
+
+// Rounds to the integer grid, dropping repeated points
+QVector<QPoint> quantize(const QPolygonF &points) {
+  QVector<QPoint> out;
+  out.reserve(points.size());
+  for (const QPointF &p : points) {
+    const QPoint q = p.toPoint();
+    if (out.isEmpty() || out.last() != q)
+      out.append(q);
+  }
+  return out;
+}
+
+// Twice the signed area, positive for clockwise rings in y-down tile space
+qint64 ringArea(const QVector<QPoint> &ring) {
+  qint64 area = 0;
+  for (int i = 0, j = ring.size() - 1; i < ring.size(); j = i++)
+    area += qint64(ring[j].x()) * ring[i].y() - qint64(ring[i].x()) * ring[j].y();
+  return area;
+}
+
+// Clipped, quantized ring in MVT winding: clockwise outer rings,
+// counter-clockwise holes. Empty when nothing with area is left.
+QVector<QPoint> tileRing(const QVector<QPointF> &ring,
+                         const QTransform &toTile, const QRectF &clip,
+                         bool outer) {
+  QPolygonF polygon = toTile.map(QPolygonF(ring));
+  if (polygon.size() > 1 && polygon.first() == polygon.last())
+    polygon.removeLast(); // OSM rings repeat their first node
+  QVector<QPoint> points = quantize(clipRing(polygon, clip));
+  if (points.size() > 1 && points.first() == points.last())
+    points.removeLast();
+  if (points.size() < 3)
+    return {};
+
+  const qint64 area = ringArea(points);
+  if (area == 0)
+    return {};
+  if ((area > 0) != outer)
+    std::reverse(points.begin(), points.end());
+  return points;
+}
+
+QString areaKind(const PolygonArea &area) {
+  for (const char *key : {"landuse", "leisure", "natural"}) {
+    const QString value = area.tags.value(key);
+    if (!value.isEmpty())
+      return value;
+  }
+  return QString();
+}
+
+// Rings of area at the level of detail, outer first. None when the area is
+// too small to draw at that level, like the renderer's tiles.
+QVector<QVector<QPointF>> areaRings(const PolygonArea &area, int lod) {
+  QVector<QVector<QPointF>> rings;
+  if (lod < 0 || lod >= area.lods.size()) {
+    rings.append(area.nodes);
+    rings += area.holes;
+    return rings;
+  }
+  const AreaLod &level = area.lods[lod];
+  if (level.triangles.isEmpty())
+    return rings;
+  int start = 0;
+  for (int size : level.ringSizes) {
+    rings.append(level.vertices.mid(start, size));
+    start += size;
+  }
+  return rings;
+}
+
+void encodeAreas(LayerBuilder &layer, const QList<PolygonArea> &areas,
+                 const RTree &index, const QRectF &mapRect,
+                 const QTransform &toTile, const QRectF &clip, float zoom,
+                 bool withKind) {
+  QVector<int> hits;
+  index.query(mapRect, hits);
+  std::sort(hits.begin(), hits.end()); // Class buckets, in draw order
+
+  const int lod = lodForZoom(zoom);
+  for (int i : hits) {
+    const PolygonArea &area = areas[i];
+    if (!isVisibleAt(area.featureClass, zoom))
+      continue;
+
+    const QVector<QVector<QPointF>> rings = areaRings(area, lod);
+    if (rings.isEmpty())
+      continue;
+    const QVector<QPoint> outer = tileRing(rings.first(), toTile, clip, true);
+    if (outer.isEmpty())
+      continue;
+    GeometryEncoder geometry;
+    geometry.addRing(outer);
+    for (int r = 1; r < rings.size(); ++r) {
+      const QVector<QPoint> inner = tileRing(rings[r], toTile, clip, false);
+      if (!inner.isEmpty())
+        geometry.addRing(inner);
+    }
+
+    LayerBuilder::Tags tags;
+    if (withKind) {
+      const QString kind = areaKind(area);
+      if (!kind.isEmpty())
+        tags.append({"class", LayerBuilder::stringValue(kind)});
+    }
+    const QString name = area.tags.value("name");
+    if (!name.isEmpty())
+      tags.append({"name", LayerBuilder::stringValue(name)});
+    layer.addFeature(quint64(area.id), Polygon, tags, geometry.commands);
+  }
+}
+
+void encodeRoads(LayerBuilder &layer, const Graph &graph,
+                 const QRectF &mapRect, const QTransform &toTile,
+                 const QRectF &clip, float zoom) {
+  QVector<int> hits;
+  graph.roadIndex.query(mapRect, hits);
+  std::sort(hits.begin(), hits.end()); // Class buckets, bottom to top
+
+  const int lod = lodForZoom(zoom);
+  for (int i : hits) {
+    const Road &road = graph.roads[i];
+    if (road.featureClass == FeatureClass::Count ||
+        !isVisibleAt(road.featureClass, zoom))
+      continue;
+
+    GeometryEncoder geometry;
+    const QPolygonF line = toTile.map(QPolygonF(road.nodesAt(lod)));
+    for (const QPolygonF &part : clipPolyline(line, clip)) {
+      const QVector<QPoint> points = quantize(part);
+      if (points.size() >= 2)
+        geometry.addLine(points);
+    }
+    if (geometry.commands.isEmpty())
+      continue;
+
+    LayerBuilder::Tags tags{{"class", LayerBuilder::stringValue(road.type)}};
+    if (!road.name.isEmpty())
+      tags.append({"name", LayerBuilder::stringValue(road.name)});
+    layer.addFeature(quint64(road.id), LineString, tags, geometry.commands);
+  }
+}
+
+// Place names keep their centers in lon/lat
+void encodePlaces(LayerBuilder &layer, const Graph &graph,
+                  const QTransform &toTile, const QRectF &clip, float zoom) {
+  quint64 id = 1;
+  for (const AreaLabel &label : graph.areaLabels) {
+    const bool visible =
+        isVisibleAt(label.isMajor ? FeatureClass::MajorAreaLabel
+                                  : FeatureClass::MinorAreaLabel,
+                    zoom);
+    const QPointF mapPos((label.center.x() - graph.minLon) * graph.scale,
+                         (label.center.y() - graph.maxLat) * graph.scale);
+    const QPointF p = toTile.map(mapPos);
+    if (!visible || !clip.contains(p)) {
+      ++id;
+      continue;
+    }
+
+    GeometryEncoder geometry;
+    geometry.addPoint(p.toPoint());
+    LayerBuilder::Tags tags{
+        {"name", LayerBuilder::stringValue(QString::fromStdString(label.name))},
+        {"major", LayerBuilder::boolValue(label.isMajor)}};
+    layer.addFeature(id++, Point, tags, geometry.commands);
+  }
+}
+
+} // namespace
+
+QByteArray encodeVectorTile(const Graph &graph, const WebTile &tile,
+                            int extent, int buffer) {
+  // Visibility and detail as on a 256 px raster tile of the same address
+  const float zoom = webTileZoom(graph, tile, 256);
+  const QTransform toTile = webTileTransform(graph, tile, extent);
+  const QRectF clip(-buffer, -buffer, extent + 2 * buffer,
+                    extent + 2 * buffer);
+  const double margin = webTileMapRect(graph, tile).width() * buffer / extent;
+  const QRectF mapRect = webTileMapRect(graph, tile)
+                             .adjusted(-margin, -margin, margin, margin);
+
+  LayerBuilder landuse("landuse", extent);
+  LayerBuilder buildings("buildings", extent);
+  LayerBuilder roads("roads", extent);
+  LayerBuilder places("places", extent);
+  encodeAreas(landuse, graph.polygons, graph.polygonIndex, mapRect, toTile,
+              clip, zoom, true);
+  encodeAreas(buildings, graph.buildings, graph.buildingIndex, mapRect, toTile,
+              clip, zoom, false);
+  encodeRoads(roads, graph, mapRect, toTile, clip, zoom);
+  encodePlaces(places, graph, toTile, clip, zoom);
+
+  ProtoWriter out;
+  for (const LayerBuilder *layer : {&landuse, &buildings, &roads, &places}) {
+    if (!layer->isEmpty())
+      out.bytes(3, layer->encode());
+  }
+  return out.data;
+}
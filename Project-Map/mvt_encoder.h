@@ -0,0 +1,16 @@
+#pragma once
+#include "graph.h"
+#include "web_tiles.h"
+#include <QByteArray>
+
+// Encodes the graph's features inside one Web Mercator tile as a Mapbox
+// Vector Tile (version 2, protobuf). Geometry is clipped to the tile plus
+// buffer units on every side and quantized to extent units. Layers:
+//   roads      lines, tags class (highway=*) and name
+//   buildings  polygons, tag name
+//   landuse    polygons, tags class (landuse/leisure/natural) and name
+//   places     points, tags name and major
+// Features hidden at the tile's zoom (see feature_rules.h) are left out.
+// Only reads the graph, so tiles can be encoded on many threads at once.
+QByteArray encodeVectorTile(const Graph &graph, const WebTile &tile,
+                            int extent = 4096, int buffer = 64);
@@ -3,19 +3,38 @@
 #include <QJsonArray>
 #include <QJsonDocument>
 #include <QJsonObject>
+#include <cmath>
+
+// Great-circle distance in meters between two nodes
+static double haversineMeters(const Node &a, const Node &b) {
+  const double earthRadius = 6371000.0;
+  const double toRad = M_PI / 180.0;
+  double dLat = (b.lat - a.lat) * toRad;
+  double dLon = (b.lon - a.lon) * toRad;
+  double h = std::sin(dLat / 2) * std::sin(dLat / 2) +
+             std::cos(a.lat * toRad) * std::cos(b.lat * toRad) *
+                 std::sin(dLon / 2) * std::sin(dLon / 2);
+  return 2.0 * earthRadius * std::asin(std::sqrt(h));
+}
 
 OSMLoader::OSMLoader(Graph &g, QObject *parent) : QObject(parent), graph(g) {}
 
-void OSMLoader::loadAreasFromJSON(const QByteArray &jsonData) {
+std::optional<QRectF>
+OSMLoader::loadAreasFromJSON(const QByteArray &jsonData) {
   QJsonDocument doc = QJsonDocument::fromJson(jsonData);
   if (!doc.isObject())
-    return;
+    return QRectF(); // Nothing changed
+
+  const bool firstLoad = graph.buildings.isEmpty();
+  const Graph::FeatureCounts before = graph.featureCounts();
 
   QJsonObject root = doc.object();
   QJsonArray elements = root["elements"].toArray();
 
   QMap<qint64, Node> tempNodes;
   QMap<qint64, PolygonArea> waysMap;
+  QSet<qint64> newNodes;    // Not in the graph yet
+  QSet<qint64> newRoadEnds; // Endpoints of new road ways
 
   // Step 1: Load all nodes
   for (const auto &elVal : elements) {
@@ -26,6 +45,8 @@ void OSMLoader::loadAreasFromJSON(const QByteArray &jsonData) {
       double lon = el["lon"].toDouble();
       Node node = {id, lat, lon, {}};
       tempNodes[id] = node;
+      if (!graph.nodes.contains(id))
+        newNodes.insert(id);
     }
   }
 
@@ -41,9 +62,12 @@ void OSMLoader::loadAreasFromJSON(const QByteArray &jsonData) {
     qint64 id = el["id"].toVariant().toLongLong();
     QJsonArray nds = el["nodes"].toArray();
     QJsonObject tags = el["tags"].toObject();
+    // Ways loaded before are still parsed, relations may refer to them
+    const bool isNew = !loadedWays.contains(id);
+    loadedWays.insert(id);
 
     // ✅ Store road
-    if (tags.contains("highway")) {
+    if (isNew && tags.contains("highway")) {
       Road road;
       road.id = id;
       road.type = tags["highway"].toString();
@@ -53,11 +77,17 @@ void OSMLoader::loadAreasFromJSON(const QByteArray &jsonData) {
 
       for (const auto &nd : nds) {
         qint64 ref = nd.toVariant().toLongLong();
-        if (tempNodes.contains(ref))
+        if (tempNodes.contains(ref)) {
           road.nodes.append(QPointF(tempNodes[ref].lon, tempNodes[ref].lat));
+          road.nodeIds.append(ref);
+        }
       }
 
       graph.roads.append(road);
+      if (!road.nodeIds.isEmpty()) {
+        newRoadEnds.insert(road.nodeIds.first());
+        newRoadEnds.insert(road.nodeIds.last());
+      }
 
       // Add edges between each pair of consecutive nodes
       for (int i = 1; i < nds.size(); ++i) {
@@ -73,6 +103,7 @@ void OSMLoader::loadAreasFromJSON(const QByteArray &jsonData) {
         Edge edge;
         edge.from = fromId;
         edge.to = toId;
+        edge.length = haversineMeters(fromNode, toNode);
         edge.name =
             tags.contains("name") ? tags["name"].toString().toStdString() : "";
         edge.highwayType = tags["highway"].toString().toStdString();
@@ -100,9 +131,9 @@ void OSMLoader::loadAreasFromJSON(const QByteArray &jsonData) {
     }
 
     // Store in appropriate list
-    if (tags.contains("building"))
+    if (isNew && tags.contains("building"))
       graph.buildings.append(poly);
-    else if (!tags.contains("highway"))
+    else if (isNew && !tags.contains("highway"))
       graph.polygons.append(poly);
 
     waysMap[id] = poly;
@@ -121,6 +152,11 @@ void OSMLoader::loadAreasFromJSON(const QByteArray &jsonData) {
     if (!tags.contains("building"))
       continue; // only buildings for now
 
+    qint64 relationId = el["id"].toVariant().toLongLong();
+    if (loadedRelations.contains(relationId))
+      continue;
+    loadedRelations.insert(relationId);
+
     QJsonArray members = el["members"].toArray();
     PolygonArea merged;
     for (auto it = tags.begin(); it != tags.end(); ++it)
@@ -128,14 +164,19 @@ void OSMLoader::loadAreasFromJSON(const QByteArray &jsonData) {
 
     for (const auto &memberVal : members) {
       QJsonObject member = memberVal.toObject();
-      if (member["type"] != "way" || member["role"] != "outer")
+      if (member["type"] != "way")
         continue;
 
       qint64 wayId = member["ref"].toVariant().toLongLong();
-      if (waysMap.contains(wayId)) {
+      if (!waysMap.contains(wayId))
+        continue;
+
+      if (member["role"] == "outer") {
         // Merge way polygon
         for (const QPointF &pt : waysMap[wayId].nodes)
           merged.nodes.append(pt);
+      } else if (member["role"] == "inner") {
+        merged.holes.append(waysMap[wayId].nodes); // Courtyards
       }
     }
 
@@ -147,7 +188,40 @@ void OSMLoader::loadAreasFromJSON(const QByteArray &jsonData) {
   for (const auto &n : tempNodes)
     graph.nodes[n.id] = n;
 
-  graph.normalizeCoordinates();
+  std::optional<QRectF> changed;
+  if (firstLoad) {
+    graph.normalizeCoordinates();
+  } else {
+    changed = graph.normalizeAppended(before);
+    qDebug() << "Appended" << graph.buildings.size() - before.buildings
+             << "buildings," << graph.polygons.size() - before.polygons
+             << "areas," << graph.roads.size() - before.roads << "road ways";
+  }
+
+  int wayCount = graph.roads.size();
+  graph.mergeRoads();
+  qDebug() << "Merged" << wayCount << "road ways into" << graph.roads.size()
+           << "polylines";
+
+  // Old roads a new way was merged into changed as well. Roads that merely
+  // cross a new way at its end are included too, a little extra redraw.
+  if (changed) {
+    for (const Road &road : graph.roads) {
+      for (qint64 id : road.nodeIds) {
+        if (newRoadEnds.contains(id)) {
+          changed = changed->united(boundsOf(road.nodes));
+          break;
+        }
+      }
+    }
+  }
+
+  graph.sortByHilbert();
+  graph.classifyFeatures();
+  graph.triangulatePolygons();
+  graph.simplifyGeometry();
+  graph.computeComponents();
+  graph.buildSpatialIndex();
 
   // Step 5: Extract actual area/place names
   for (const auto &elVal : elements) {
@@ -159,6 +233,8 @@ void OSMLoader::loadAreasFromJSON(const QByteArray &jsonData) {
     QJsonObject tags = el["tags"].toObject();
     if (!tags.contains("place") || !tags.contains("name"))
       continue;
+    if (!newNodes.contains(el["id"].toVariant().toLongLong()))
+      continue; // Labeled by an earlier load
 
     QString placeType = tags["place"].toString();
     QString name = tags["name"].toString();
@@ -177,4 +253,6 @@ void OSMLoader::loadAreasFromJSON(const QByteArray &jsonData) {
       graph.areaLabels.push_back(label);
     }
   }
+
+  return changed;
 }
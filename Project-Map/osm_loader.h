@@ -2,15 +2,23 @@
 #include "graph.h"
 #include <QJsonDocument>
 #include <QObject>
+#include <QRectF>
+#include <QSet>
+#include <optional>
 
 class OSMLoader : public QObject {
   Q_OBJECT
 
 public:
   explicit OSMLoader(Graph &graph, QObject *parent = nullptr);
-  void loadAreasFromJSON(const QByteArray &jsonData);
+  // The first load sets up the map and returns nullopt. Later ones append
+  // only ways, relations and places not loaded yet, in the same map frame,
+  // and return the map area that changed.
+  std::optional<QRectF> loadAreasFromJSON(const QByteArray &jsonData);
   void detectTwinEdgesWithSameName();
 
 private:
   Graph &graph;
+  QSet<qint64> loadedWays;
+  QSet<qint64> loadedRelations;
 };
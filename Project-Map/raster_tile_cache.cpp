@@ -0,0 +1,244 @@
+#include "raster_tile_cache.h"
+#include "map_renderer.h"
+#include <QDebug>
+#include <QOpenGLFramebufferObjectFormat>
+#include <QVector4D>
+#include <cmath>
+
+namespace {
+
+constexpr int cornerAttribute = 0;
+
+const char *compositeVertexShader = R"(
+ATTRIBUTE vec2 a_corner;
+uniform mat4 u_matrix;
+uniform vec4 u_rect; // Map-space x, y, width, height
+VARYING vec2 v_texCoord;
+
+void main() {
+  v_texCoord = a_corner;
+  gl_Position = u_matrix * vec4(u_rect.xy + a_corner * u_rect.zw, 0.0, 1.0);
+}
+)";
+
+// Tiles were drawn with blending, so their alpha is not meaningful
+const char *compositeFragmentShader = R"(
+VARYING vec2 v_texCoord;
+uniform sampler2D u_tile;
+
+void main() {
+  FRAG_COLOR = vec4(TEXTURE(u_tile, v_texCoord).rgb, 1.0);
+}
+)";
+
+} // namespace
+
+RasterTileCache::~RasterTileCache() { clear(); }
+
+void RasterTileCache::initialize() {
+  initializeOpenGLFunctions();
+
+  program.addShaderFromSourceCode(
+      QOpenGLShader::Vertex,
+      MapRenderer::shaderSource(compositeVertexShader, true));
+  program.addShaderFromSourceCode(
+      QOpenGLShader::Fragment,
+      MapRenderer::shaderSource(compositeFragmentShader, false));
+  program.bindAttributeLocation("a_corner", cornerAttribute);
+  if (!program.link())
+    qWarning() << "Tile composite shader failed to link:" << program.log();
+
+  // Core profiles draw nothing without a VAO; it keeps the layout once
+  const float corners[] = {0, 0, 1, 0, 0, 1, 1, 1};
+  if (quadVao.create())
+    quadVao.bind();
+  quad.create();
+  quad.bind();
+  quad.allocate(corners, sizeof(corners));
+  if (quadVao.isCreated()) {
+    glEnableVertexAttribArray(cornerAttribute);
+    glVertexAttribPointer(cornerAttribute, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
+    quadVao.release();
+  }
+  quad.release();
+}
+
+void RasterTileCache::cleanup() {
+  clear();
+  quadVao.destroy();
+  quad.destroy();
+}
+
+void RasterTileCache::invalidate() { stale = true; }
+
+void RasterTileCache::invalidate(const QRectF &changed) {
+  staleArea = staleArea.united(changed);
+}
+
+void RasterTileCache::clear() {
+  for (RasterTile *tile : tiles)
+    delete tile;
+  tiles.clear();
+  visible.clear();
+}
+
+bool RasterTileCache::render(const Camera &camera, qreal devicePixelRatio,
+                             const RenderFunction &renderLayers) {
+  // Moved to a screen of another pixel density: every tile has the wrong size
+  if (devicePixelRatio != tileRatio) {
+    tileRatio = devicePixelRatio;
+    tilePixels = int(std::ceil(tileSize * devicePixelRatio));
+    bytesPerTile = qint64(tilePixels) * tilePixels * 8;
+    stale = true;
+  }
+
+  if (stale) {
+    clear();
+    stale = false;
+  } else if (!staleArea.isNull()) {
+    for (auto it = tiles.begin(); it != tiles.end();) {
+      RasterTile *tile = it.value();
+      const double margin = overdrawPixels / tile->key.zoom;
+      if (!tile->rect.intersects(
+              staleArea.adjusted(-margin, -margin, margin, margin))) {
+        ++it;
+        continue;
+      }
+      delete tile;
+      it = tiles.erase(it);
+    }
+  }
+  staleArea = QRectF();
+
+  ++frame;
+  rendered = 0;
+  missing = 0;
+  visible.clear();
+
+  const QRectF view = camera.visibleMapRect();
+  const double size = tileSize / camera.zoom; // Map units per tile
+  const int x0 = int(std::floor(view.left() / size));
+  const int x1 = int(std::floor(view.right() / size));
+  const int y0 = int(std::floor(view.top() / size));
+  const int y1 = int(std::floor(view.bottom() / size));
+
+  // Tiles render with their own viewport and framebuffer. The caller's
+  // target isn't necessarily the context default (render thread FBOs).
+  GLint viewport[4];
+  glGetIntegerv(GL_VIEWPORT, viewport);
+  GLint target = 0;
+  glGetIntegerv(GL_FRAMEBUFFER_BINDING, &target);
+
+  for (int y = y0; y <= y1; ++y) {
+    for (int x = x0; x <= x1; ++x) {
+      RasterTileKey key{camera.zoom, x, y};
+      RasterTile *tile = tiles.value(key, nullptr);
+      if (!tile) {
+        if (rendered == maxTilesPerFrame) {
+          ++missing;
+          continue;
+        }
+        tile = createTile(key, renderLayers);
+        tiles.insert(key, tile);
+        ++rendered;
+      }
+      tile->lastUsed = frame;
+      visible.append(tile);
+    }
+  }
+
+  if (rendered > 0) {
+    glBindFramebuffer(GL_FRAMEBUFFER, GLuint(target));
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+  }
+  evict();
+  if (missing > 0)
+    return false;
+
+  // Composite: one textured quad per tile
+  if (profiler)
+    profiler->begin(FrameProfiler::Composite);
+  glDisable(GL_BLEND);
+  program.bind();
+  program.setUniformValue("u_matrix", camera.viewMatrix());
+  program.setUniformValue("u_tile", 0);
+  if (quadVao.isCreated()) {
+    quadVao.bind();
+  } else {
+    quad.bind();
+    glEnableVertexAttribArray(cornerAttribute);
+    glVertexAttribPointer(cornerAttribute, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
+  }
+  glActiveTexture(GL_TEXTURE0);
+
+  for (RasterTile *tile : visible) {
+    program.setUniformValue("u_rect", QVector4D(tile->rect.x(), tile->rect.y(),
+                                                tile->rect.width(),
+                                                tile->rect.height()));
+    glBindTexture(GL_TEXTURE_2D, tile->fbo->texture());
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+  }
+
+  glBindTexture(GL_TEXTURE_2D, 0);
+  if (quadVao.isCreated()) {
+    quadVao.release();
+  } else {
+    glDisableVertexAttribArray(cornerAttribute);
+    quad.release();
+  }
+  program.release();
+  glEnable(GL_BLEND);
+  if (profiler)
+    profiler->end(FrameProfiler::Composite);
+  return true;
+}
+
+RasterTile *RasterTileCache::createTile(const RasterTileKey &key,
+                                        const RenderFunction &renderLayers) {
+  auto *tile = new RasterTile;
+  tile->key = key;
+  const double size = tileSize / key.zoom;
+  tile->rect = QRectF(key.x * size, key.y * size, size, size);
+
+  QOpenGLFramebufferObjectFormat format;
+  format.setAttachment(QOpenGLFramebufferObject::CombinedDepthStencil);
+  tile->fbo = std::make_unique<QOpenGLFramebufferObject>(
+      QSize(tilePixels, tilePixels), format);
+
+  // Same projection as the screen, centered on the tile
+  Camera camera;
+  camera.zoom = key.zoom;
+  camera.panX = -tile->rect.center().x();
+  camera.panY = -tile->rect.center().y();
+  camera.viewport = QSize(tileSize, tileSize);
+
+  // Laid out in logical pixels, rasterized at the screen's density
+  tile->fbo->bind();
+  glViewport(0, 0, tilePixels, tilePixels);
+  renderLayers(camera);
+
+  // Nearest keeps text and thin roads crisp at fractional pan offsets
+  glBindTexture(GL_TEXTURE_2D, tile->fbo->texture());
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glBindTexture(GL_TEXTURE_2D, 0);
+  return tile;
+}
+
+// Drops least-recently-used tiles until the budget holds. Tiles on screen
+// this frame are never evicted.
+void RasterTileCache::evict() {
+  while (vramBytes() > vramBudget) {
+    RasterTile *oldest = nullptr;
+    for (RasterTile *tile : tiles) {
+      if (tile->lastUsed != frame &&
+          (!oldest || tile->lastUsed < oldest->lastUsed))
+        oldest = tile;
+    }
+    if (!oldest)
+      break;
+
+    tiles.remove(oldest->key);
+    delete oldest;
+  }
+}
@@ -0,0 +1,105 @@
+#pragma once
+#include "camera.h"
+#include "frame_profiler.h"
+#include <QHash>
+#include <QOpenGLBuffer>
+#include <QOpenGLFramebufferObject>
+#include <QOpenGLFunctions>
+#include <QOpenGLShaderProgram>
+#include <QOpenGLVertexArrayObject>
+#include <QRectF>
+#include <QVector>
+#include <functional>
+#include <memory>
+
+// Address of a rendered tile: tileSize screen pixels square at one exact
+// zoom, so tile (x, y) covers map units [x, x + 1) * tileSize / zoom
+struct RasterTileKey {
+  float zoom = 1.0f;
+  int x = 0;
+  int y = 0;
+
+  bool operator==(const RasterTileKey &o) const {
+    return zoom == o.zoom && x == o.x && y == o.y;
+  }
+};
+
+inline size_t qHash(const RasterTileKey &key, size_t seed = 0) {
+  return qHashMulti(seed, key.zoom, key.x, key.y);
+}
+
+struct RasterTile {
+  RasterTileKey key;
+  QRectF rect; // Map units
+  std::unique_ptr<QOpenGLFramebufferObject> fbo;
+  quint64 lastUsed = 0;
+};
+
+// Offscreen cache of the fully rendered map, in framebuffer-object tiles.
+// Panning only composites cached tiles; tiles are rendered when they first
+// come into view and evicted least-recently-used once the VRAM budget is
+// used up. All methods except the invalidate ones need the GL context to be
+// current.
+class RasterTileCache : protected QOpenGLFunctions {
+public:
+  static constexpr int tileSize = 256; // Logical pixels
+  // Missing tiles rendered per frame; a fresh zoom fills in over a few
+  static constexpr int maxTilesPerFrame = 4;
+  // Color plus depth/stencil, at a device pixel ratio of 1
+  static constexpr qint64 tileBytes = qint64(tileSize) * tileSize * 8;
+
+  // Draws every map layer for camera into the bound framebuffer
+  using RenderFunction = std::function<void(const Camera &)>;
+
+  RasterTileCache() = default;
+  ~RasterTileCache();
+
+  void initialize();
+  void cleanup();
+  void invalidate(); // Map content changed, re-render tiles on next use
+  // Only content inside changed (map units) did; drops just the tiles that
+  // show it. Both only set flags, no GL needed.
+  void invalidate(const QRectF &changed);
+  // How far road casings reach past their centerline, at most a miter of
+  // the widest casing
+  static constexpr float overdrawPixels = 12.0f;
+
+  void setVramBudget(qint64 bytes) { vramBudget = bytes; }
+  qint64 vramBudgetBytes() const { return vramBudget; }
+  qint64 vramBytes() const { return tiles.size() * bytesPerTile; }
+  int tileCount() const { return tiles.size(); }
+  int tilesRenderedLastFrame() const { return rendered; }
+  void setProfiler(FrameProfiler *p) { profiler = p; } // Times compositing
+
+  // Renders up to maxTilesPerFrame of the tiles camera's view is missing.
+  // Once none are missing, draws all of them into the bound framebuffer and
+  // returns true; otherwise draws nothing and the caller renders the frame
+  // itself. Tiles get devicePixelRatio texels per logical pixel, so they
+  // composite 1:1 onto the framebuffer.
+  bool render(const Camera &camera, qreal devicePixelRatio,
+              const RenderFunction &renderLayers);
+  // The last render left tiles of its view missing
+  bool hasMissingTiles() const { return missing > 0; }
+
+private:
+  RasterTile *createTile(const RasterTileKey &key,
+                         const RenderFunction &renderLayers);
+  void clear();
+  void evict();
+
+  QHash<RasterTileKey, RasterTile *> tiles;
+  QVector<RasterTile *> visible;
+  QOpenGLShaderProgram program;
+  QOpenGLBuffer quad{QOpenGLBuffer::VertexBuffer}; // Unit square strip
+  QOpenGLVertexArrayObject quadVao; // Not created when VAOs are unsupported
+  qint64 vramBudget = 64ll * 1024 * 1024;
+  FrameProfiler *profiler = nullptr;
+  quint64 frame = 0;
+  int rendered = 0;
+  int missing = 0;
+  qreal tileRatio = 1; // Device pixel ratio of the cached tiles
+  int tilePixels = tileSize;
+  qint64 bytesPerTile = tileBytes;
+  bool stale = false;
+  QRectF staleArea; // Map units, when only part of the content changed
+};
@@ -0,0 +1,102 @@
+#include "raster_tiles.h"
+#include "map_style.h"
+#include <QPainter>
+#include <QPainterPath>
+#include <algorithm>
+
+namespace {
+
+// Outer ring plus holes, holes cut out by the odd-even rule
+QPainterPath areaPath(const PolygonArea &area) {
+  QPainterPath path;
+  path.setFillRule(Qt::OddEvenFill);
+  path.addPolygon(QPolygonF(area.nodes));
+  for (const auto &hole : area.holes)
+    path.addPolygon(QPolygonF(hole));
+  return path;
+}
+
+void drawAreas(QPainter &painter, const QList<PolygonArea> &areas,
+               const RTree &index, const QRectF &rect, float zoom) {
+  QVector<int> hits;
+  index.query(rect, hits);
+  std::sort(hits.begin(), hits.end()); // Class buckets, in draw order
+
+  painter.setPen(Qt::NoPen);
+  for (int i : hits) {
+    const PolygonArea &area = areas[i];
+    if (area.nodes.size() < 3 || !isVisibleAt(area.featureClass, zoom))
+      continue;
+
+    // Sub-pixel areas only cost time
+    const QRectF box = QPolygonF(area.nodes).boundingRect();
+    if (std::max(box.width(), box.height()) * zoom < 0.5)
+      continue;
+
+    painter.setBrush(areaColor(area.featureClass));
+    painter.drawPath(areaPath(area));
+  }
+}
+
+// Class by class, casing then fill, the order the GL road pass layers them
+void drawRoads(QPainter &painter, const Graph &graph, const QRectF &rect,
+               float zoom) {
+  QVector<int> hits;
+  graph.roadIndex.query(rect, hits);
+  std::sort(hits.begin(), hits.end()); // Class buckets, bottom to top
+
+  const int lod = lodForZoom(zoom);
+  painter.setBrush(Qt::NoBrush);
+
+  int begin = 0;
+  while (begin < hits.size()) {
+    const FeatureClass cls = graph.roads[hits[begin]].featureClass;
+    int end = begin;
+    while (end < hits.size() && graph.roads[hits[end]].featureClass == cls)
+      ++end;
+
+    if (cls != FeatureClass::Count && isVisibleAt(cls, zoom)) {
+      const RoadStyle &style = roadStyle(cls);
+      for (bool casing : {true, false}) {
+        // Widths are in pixels, the painter works in map units
+        QPen pen(casing ? style.casingColor : style.fillColor,
+                 (casing ? style.casingWidth : style.width) / zoom);
+        pen.setCapStyle(Qt::RoundCap);
+        pen.setJoinStyle(Qt::RoundJoin);
+        painter.setPen(pen);
+
+        for (int h = begin; h < end; ++h) {
+          const QVector<QPointF> &nodes = graph.roads[hits[h]].nodesAt(lod);
+          painter.drawPolyline(nodes.constData(), nodes.size());
+        }
+      }
+    }
+    begin = end;
+  }
+}
+
+} // namespace
+
+QImage renderRasterTile(const Graph &graph, const WebTile &tile, int extent) {
+  QImage image(extent, extent, QImage::Format_ARGB32_Premultiplied);
+  image.fill(backgroundColor());
+
+  const float zoom = webTileZoom(graph, tile, extent);
+
+  // Grow the query by the widest road so strokes crossing the edge are drawn
+  float widest = 0.0f;
+  for (int c = 0; c < roadClassCount; ++c)
+    widest = std::max(widest, roadStyle(FeatureClass(c)).casingWidth);
+  const double margin = widest / zoom;
+  const QRectF rect = webTileMapRect(graph, tile)
+                          .adjusted(-margin, -margin, margin, margin);
+
+  QPainter painter(&image);
+  painter.setRenderHint(QPainter::Antialiasing);
+  painter.setTransform(webTileTransform(graph, tile, extent));
+
+  drawAreas(painter, graph.buildings, graph.buildingIndex, rect, zoom);
+  drawAreas(painter, graph.polygons, graph.polygonIndex, rect, zoom);
+  drawRoads(painter, graph, rect, zoom);
+  return image;
+}
@@ -0,0 +1,10 @@
+#pragma once
+#include "graph.h"
+#include "web_tiles.h"
+#include <QImage>
+
+// CPU rendering of one Web Mercator tile with QPainter, in the MapWidget
+// style (see map_style.h). Only reads the graph, so tiles can be rendered
+// on any number of threads at once.
+QImage renderRasterTile(const Graph &graph, const WebTile &tile,
+                        int extent = 256);
@@ -0,0 +1,229 @@
+#include "render_thread.h"
+#include <QDebug>
+#include <QOpenGLFunctions>
+#include <QOpenGLPaintDevice>
+#include <QPainter>
+#include <utility>
+
+namespace {
+
+bool sameView(const RenderThread::FrameRequest &a,
+              const RenderThread::FrameRequest &b) {
+  return a.camera.zoom == b.camera.zoom && a.camera.panX == b.camera.panX &&
+         a.camera.panY == b.camera.panY &&
+         a.camera.viewport == b.camera.viewport &&
+         a.devicePixelRatio == b.devicePixelRatio &&
+         a.showProfiler == b.showProfiler;
+}
+
+} // namespace
+
+RenderThread::RenderThread(const Graph &g, QObject *parent)
+    : QThread(parent), renderer(g) {}
+
+RenderThread::~RenderThread() { stopRendering(); }
+
+void RenderThread::startRendering(QOpenGLContext *shareContext) {
+  context = std::make_unique<QOpenGLContext>();
+  context->setFormat(shareContext->format());
+  context->setShareContext(shareContext);
+  if (!context->create()) {
+    qWarning() << "Cannot create a shared GL context for the render thread";
+    context.reset();
+    return;
+  }
+
+  // Offscreen surfaces have to be created on the GUI thread
+  surface = std::make_unique<QOffscreenSurface>();
+  surface->setFormat(context->format());
+  surface->create();
+
+  const QPair<int, int> version = context->format().version();
+  fences = version >= (context->isOpenGLES() ? qMakePair(3, 0)
+                                             : qMakePair(3, 2));
+
+  context->moveToThread(this);
+  start();
+}
+
+void RenderThread::stopRendering() {
+  if (!isRunning())
+    return;
+  {
+    QMutexLocker lock(&mutex);
+    quitting = true;
+    wake.wakeOne();
+  }
+  wait();
+  surface.reset();
+}
+
+void RenderThread::requestFrame(const FrameRequest &request) {
+  QMutexLocker lock(&mutex);
+  const bool changed = !sameView(request, pending);
+  pending = request; // Keeps the GUI timings fresh either way
+  if (!changed)
+    return;
+  frameWanted = true;
+  wake.wakeOne();
+}
+
+RenderThread::Frame RenderThread::takeFrame() {
+  QMutexLocker lock(&mutex);
+  if (hasReady) {
+    std::swap(displayed, ready);
+    hasReady = false;
+  }
+  const Target &target = targets[displayed];
+  if (!target.fbo)
+    return Frame();
+  return {target.fbo->texture(), target.fbo->size(), target.camera};
+}
+
+void RenderThread::frameShown() {
+  QOpenGLContext *gui = QOpenGLContext::currentContext();
+  if (!fences) {
+    gui->functions()->glFinish();
+    return;
+  }
+
+  // Flushed, or the render context could wait on a fence never submitted
+  QOpenGLExtraFunctions *gl = gui->extraFunctions();
+  const GLsync fence = gl->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  gl->glFlush();
+  QMutexLocker lock(&mutex);
+  // Blits of one context finish in order, so the newest fence covers all
+  const GLsync previous = std::exchange(targets[displayed].shown, fence);
+  if (previous)
+    gl->glDeleteSync(previous);
+}
+
+void RenderThread::modifyGraph(
+    const std::function<std::optional<QRectF>()> &change) {
+  {
+    QMutexLocker lock(&graphMutex);
+    renderer.waitForPrefetch(); // Tile builds read the graph
+    // Only flags, no GL
+    if (const std::optional<QRectF> changed = change())
+      renderer.invalidate(*changed);
+    else
+      renderer.invalidate();
+  }
+  QMutexLocker lock(&mutex);
+  frameWanted = true;
+  wake.wakeOne();
+}
+
+void RenderThread::exportProfile(const QString &fileName) {
+  QMutexLocker lock(&mutex);
+  profileFileName = fileName;
+  frameWanted = true;
+  wake.wakeOne();
+}
+
+void RenderThread::run() {
+  context->makeCurrent(surface.get());
+  renderer.initialize();
+
+  for (;;) {
+    FrameRequest request;
+    QString profileFile;
+    {
+      QMutexLocker lock(&mutex);
+      while (!quitting && !frameWanted) {
+        // Finished label layouts and missing raster tiles show up without
+        // anyone asking
+        if (renderer.hasPendingWork()) {
+          wake.wait(&mutex, pendingPollMs);
+          break;
+        }
+        wake.wait(&mutex);
+      }
+      if (quitting)
+        break;
+      frameWanted = false;
+      request = pending;
+      profileFile = std::exchange(profileFileName, QString());
+    }
+
+    QMutexLocker lock(&graphMutex);
+    renderFrame(request);
+
+    if (!profileFile.isEmpty()) {
+      FrameProfiler &profiler = renderer.frameProfiler();
+      if (profiler.exportCsv(profileFile))
+        qDebug() << "Wrote" << profiler.history().size() << "frames to"
+                 << profileFile;
+      else
+        qWarning() << "Cannot write" << profileFile;
+    }
+  }
+
+  // GL resources go with the context, on this thread
+  renderer.cleanup();
+  for (Target &target : targets) {
+    if (target.shown)
+      context->extraFunctions()->glDeleteSync(target.shown);
+    target.fbo.reset();
+  }
+  context->doneCurrent();
+  context.reset();
+}
+
+void RenderThread::renderFrame(const FrameRequest &request) {
+  const QSize size = request.camera.viewport * request.devicePixelRatio;
+  if (size.isEmpty())
+    return;
+
+  // The GPU finishes the GUI's blits of this texture before drawing into it
+  Target &target = targets[rendering];
+  GLsync shown = nullptr;
+  {
+    QMutexLocker lock(&mutex);
+    shown = std::exchange(target.shown, nullptr);
+  }
+  if (shown) {
+    QOpenGLExtraFunctions *extra = context->extraFunctions();
+    extra->glWaitSync(shown, 0, GL_TIMEOUT_IGNORED);
+    extra->glDeleteSync(shown);
+  }
+
+  if (!target.fbo || target.fbo->size() != size) {
+    QOpenGLFramebufferObjectFormat format;
+    format.setAttachment(QOpenGLFramebufferObject::CombinedDepthStencil);
+    target.fbo = std::make_unique<QOpenGLFramebufferObject>(size, format);
+  }
+
+  FrameProfiler &profiler = renderer.frameProfiler();
+  profiler.setEnabled(request.showProfiler);
+  profiler.beginFrame();
+  profiler.addCpuTime(FrameProfiler::AreaLabels, request.areaLabelNanos);
+
+  // Step 1: Map layers, then prefetch for where the view is heading
+  QOpenGLFunctions *gl = context->functions();
+  target.fbo->bind();
+  gl->glViewport(0, 0, size.width(), size.height());
+  renderer.render(request.camera, request.devicePixelRatio);
+  renderer.prefetch(request.predicted);
+  profiler.endFrame();
+
+  // Step 2: Profiler overlay, painted straight into the frame
+  if (request.showProfiler) {
+    QOpenGLPaintDevice device(size);
+    device.setDevicePixelRatio(request.devicePixelRatio);
+    QPainter painter(&device);
+    profiler.drawOverlay(painter, QRect(QPoint(), request.camera.viewport));
+  }
+  target.fbo->release();
+
+  // Step 3: Hand it over. The GUI context samples the texture next, and
+  // glFinish is the one sync that works across shared contexts everywhere.
+  gl->glFinish();
+  target.camera = request.camera;
+  {
+    QMutexLocker lock(&mutex);
+    std::swap(rendering, ready);
+    hasReady = true;
+  }
+  emit frameReady();
+}
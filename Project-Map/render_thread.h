@@ -0,0 +1,97 @@
+#pragma once
+#include "camera.h"
+#include "graph.h"
+#include "map_renderer.h"
+#include <QMutex>
+#include <QOffscreenSurface>
+#include <QOpenGLContext>
+#include <QOpenGLExtraFunctions>
+#include <QOpenGLFramebufferObject>
+#include <QThread>
+#include <QWaitCondition>
+#include <functional>
+#include <memory>
+#include <optional>
+
+// Renders the map layers on a thread of its own, into framebuffer textures
+// of a context shared with the widget. The GUI thread posts the view it
+// wants and picks up the newest finished frame; neither side waits for the
+// other, except while the graph is being changed. Three framebuffers
+// rotate between rendering, ready and on screen. A framebuffer comes back
+// to the render thread with a fence behind the GUI's last blit of it, which
+// the render thread waits on before drawing into it again.
+class RenderThread : public QThread {
+  Q_OBJECT
+
+public:
+  struct FrameRequest {
+    Camera camera;
+    Camera predicted; // Where the view is heading, for prefetching
+    qreal devicePixelRatio = 1;
+    bool showProfiler = false;
+    qint64 areaLabelNanos = 0; // GUI painting area names, last frame shown
+  };
+
+  // A finished frame, valid until the next takeFrame
+  struct Frame {
+    GLuint texture = 0; // 0 until the first frame is done
+    QSize size;         // Pixels
+    Camera camera;      // View it was rendered for
+  };
+
+  static constexpr int pendingPollMs = 16; // While renderer work is pending
+
+  explicit RenderThread(const Graph &graph, QObject *parent = nullptr);
+  ~RenderThread();
+
+  // From initializeGL, with the widget's context current
+  void startRendering(QOpenGLContext *shareContext);
+  void stopRendering(); // Frees GL resources and joins the thread
+
+  // GUI thread
+  void requestFrame(const FrameRequest &request);
+  Frame takeFrame();
+  // After the blit of the frame taken last, with the widget's context
+  // current: fences the reads of its texture
+  void frameShown();
+  // Runs change on the calling thread while no frame renders, then has
+  // the renderer rebuild what changed: the map area change returns, or
+  // everything for nullopt
+  void modifyGraph(const std::function<std::optional<QRectF>()> &change);
+  void exportProfile(const QString &fileName); // Written by the next frame
+
+signals:
+  void frameReady(); // Emitted from the render thread
+
+protected:
+  void run() override;
+
+private:
+  struct Target {
+    std::unique_ptr<QOpenGLFramebufferObject> fbo;
+    Camera camera;
+    GLsync shown = nullptr; // GUI's last blit of the texture
+  };
+
+  void renderFrame(const FrameRequest &request);
+
+  MapRenderer renderer; // Render thread only, or under graphMutex
+  std::unique_ptr<QOpenGLContext> context;
+  std::unique_ptr<QOffscreenSurface> surface;
+  bool fences = false; // GL 3.2 or ES 3.0, else the GUI side glFinishes
+
+  // Guards everything below; held only briefly by either thread
+  QMutex mutex;
+  QWaitCondition wake;
+  FrameRequest pending;
+  bool frameWanted = false;
+  bool quitting = false;
+  QString profileFileName;
+  Target targets[3];
+  int rendering = 0;
+  int ready = 1;
+  int displayed = 2;
+  bool hasReady = false;
+
+  QMutex graphMutex; // Held while a frame renders
+};
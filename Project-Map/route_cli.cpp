@@ -0,0 +1,172 @@
+#include "graph.h"
+#include "osm_loader.h"
+#include "router.h"
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+// Headless batch router: loads a saved Overpass JSON file, answers a file of
+// "fromNodeId toNodeId" pairs on a worker pool and reports throughput.
+
+struct Query {
+  qint64 from;
+  qint64 to;
+};
+
+static bool readQueries(const QString &fileName, std::vector<Query> &queries) {
+  QFile file(fileName);
+  if (!file.open(QIODevice::ReadOnly))
+    return false;
+
+  while (!file.atEnd()) {
+    QByteArray line = file.readLine().trimmed();
+    if (line.isEmpty() || line.startsWith('#'))
+      continue;
+
+    QList<QByteArray> parts = line.replace(',', ' ').simplified().split(' ');
+    if (parts.size() < 2)
+      continue;
+
+    bool okFrom = false, okTo = false;
+    Query query{parts[0].toLongLong(&okFrom), parts[1].toLongLong(&okTo)};
+    if (okFrom && okTo)
+      queries.push_back(query);
+  }
+  return true;
+}
+
+static double percentile(const std::vector<qint64> &sorted, double p) {
+  if (sorted.empty())
+    return 0.0;
+  size_t i = std::min(sorted.size() - 1, size_t(p * (sorted.size() - 1)));
+  return sorted[i] / 1000.0; // ns -> us
+}
+
+int main(int argc, char *argv[]) {
+  QCoreApplication app(argc, argv);
+  QCoreApplication::setApplicationName("MiniMapRoute");
+
+  QCommandLineParser parser;
+  parser.setApplicationDescription("Batch shortest-path queries over a map");
+  parser.addHelpOption();
+  parser.addPositionalArgument("map", "Overpass JSON file to load");
+  parser.addPositionalArgument("queries", "File of 'from to' node id pairs");
+  parser.addPositionalArgument("output", "File to write the results to");
+  QCommandLineOption threadsOption({"j", "threads"}, "Worker threads", "n",
+                                   QString::number(std::max(
+                                       1u, std::thread::hardware_concurrency())));
+  QCommandLineOption pathsOption("paths", "Write node paths, not only distances");
+  parser.addOption(threadsOption);
+  parser.addOption(pathsOption);
+  parser.process(app);
+
+  const QStringList args = parser.positionalArguments();
+  if (args.size() != 3)
+    parser.showHelp(1);
+
+  // Step 1: Load the graph
+  QElapsedTimer timer;
+  timer.start();
+
+  QFile mapFile(args[0]);
+  if (!mapFile.open(QIODevice::ReadOnly)) {
+    fprintf(stderr, "Cannot open map file %s\n", qPrintable(args[0]));
+    return 1;
+  }
+
+  Graph graph;
+  OSMLoader loader(graph);
+  loader.loadAreasFromJSON(mapFile.readAll());
+  Router router(graph);
+  fprintf(stderr, "Loaded %d nodes, %d edges in %lld ms\n",
+          router.nodeCount(), int(graph.edges.size()), timer.restart());
+
+  // Step 2: Read the queries
+  std::vector<Query> queries;
+  if (!readQueries(args[1], queries)) {
+    fprintf(stderr, "Cannot open query file %s\n", qPrintable(args[1]));
+    return 1;
+  }
+  fprintf(stderr, "Read %zu queries in %lld ms\n", queries.size(),
+          timer.restart());
+
+  // Step 3: Answer them on the worker pool. Workers pull fixed-size chunks
+  // and format their own output so the writer only concatenates.
+  const size_t chunkSize = 256;
+  const size_t chunkCount = (queries.size() + chunkSize - 1) / chunkSize;
+  const bool writePaths = parser.isSet(pathsOption);
+  const int threadCount = std::max(1, parser.value(threadsOption).toInt());
+
+  std::vector<QByteArray> output(chunkCount);
+  std::vector<qint64> latencies(queries.size());
+  std::atomic<size_t> nextChunk{0};
+  std::atomic<int> unreachable{0};
+
+  auto worker = [&]() {
+    RouteSearch search;
+    QElapsedTimer queryTimer;
+
+    for (size_t chunk = nextChunk++; chunk < chunkCount; chunk = nextChunk++) {
+      size_t begin = chunk * chunkSize;
+      size_t end = std::min(queries.size(), begin + chunkSize);
+      QByteArray &out = output[chunk];
+
+      for (size_t i = begin; i < end; ++i) {
+        queryTimer.start();
+        RouteResult result = router.route(queries[i].from, queries[i].to,
+                                          search);
+        latencies[i] = queryTimer.nsecsElapsed();
+
+        out += QByteArray::number(queries[i].from) + ' ' +
+               QByteArray::number(queries[i].to) + ' ';
+        if (!result.found) {
+          ++unreachable;
+          out += "-1\n";
+          continue;
+        }
+
+        out += QByteArray::number(result.distance, 'f', 1);
+        if (writePaths) {
+          for (qint64 id : result.path)
+            out += ' ' + QByteArray::number(id);
+        }
+        out += '\n';
+      }
+    }
+  };
+
+  std::vector<std::thread> workers;
+  for (int t = 0; t < threadCount; ++t)
+    workers.emplace_back(worker);
+  for (auto &thread : workers)
+    thread.join();
+
+  const qint64 elapsedNs = timer.nsecsElapsed();
+
+  // Step 4: Write results and report
+  QFile outFile(args[2]);
+  if (!outFile.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+    fprintf(stderr, "Cannot write output file %s\n", qPrintable(args[2]));
+    return 1;
+  }
+  for (const QByteArray &chunk : output)
+    outFile.write(chunk);
+
+  std::sort(latencies.begin(), latencies.end());
+  double seconds = elapsedNs / 1e9;
+  fprintf(stderr,
+          "%zu queries on %d threads in %.3f s (%.0f queries/s), "
+          "%d unreachable\n",
+          queries.size(), threadCount, seconds,
+          seconds > 0 ? queries.size() / seconds : 0.0, unreachable.load());
+  fprintf(stderr, "Latency us: p50 %.1f  p90 %.1f  p99 %.1f  max %.1f\n",
+          percentile(latencies, 0.50), percentile(latencies, 0.90),
+          percentile(latencies, 0.99), percentile(latencies, 1.0));
+  return 0;
+}
@@ -0,0 +1,114 @@
+#include "router.h"
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <queue>
+
+Router::Router(const Graph &graph) {
+  auto indexOf = [&](qint64 id) {
+    auto it = index.constFind(id);
+    if (it != index.constEnd())
+      return it.value();
+    index.insert(id, ids.size());
+    ids.append(id);
+    return int(ids.size() - 1);
+  };
+
+  // Step 1: Dense node indices and out-degrees
+  QVector<QPair<int, int>> links;
+  links.reserve(graph.edges.size());
+  for (const Edge &edge : graph.edges)
+    links.append(qMakePair(indexOf(edge.from), indexOf(edge.to)));
+
+  const int n = ids.size();
+  offsets.fill(0, n + 1);
+  for (int i = 0; i < links.size(); ++i) {
+    ++offsets[links[i].first + 1];
+    if (!graph.edges[i].oneway)
+      ++offsets[links[i].second + 1];
+  }
+  for (int i = 0; i < n; ++i)
+    offsets[i + 1] += offsets[i];
+
+  // Step 2: Pack the adjacency (both directions unless oneway)
+  targets.resize(offsets[n]);
+  weights.resize(offsets[n]);
+  QVector<int> fill = offsets;
+  for (int i = 0; i < links.size(); ++i) {
+    const Edge &edge = graph.edges[i];
+    int slot = fill[links[i].first]++;
+    targets[slot] = links[i].second;
+    weights[slot] = edge.length;
+    if (!edge.oneway) {
+      slot = fill[links[i].second]++;
+      targets[slot] = links[i].first;
+      weights[slot] = edge.length;
+    }
+  }
+
+  component.resize(n);
+  for (int i = 0; i < n; ++i)
+    component[i] = graph.weakComponent.value(ids[i], -1);
+}
+
+RouteResult Router::route(qint64 from, qint64 to, RouteSearch &search) const {
+  RouteResult result;
+  auto a = index.constFind(from);
+  auto b = index.constFind(to);
+  if (a == index.constEnd() || b == index.constEnd())
+    return result;
+
+  const int source = a.value();
+  const int target = b.value();
+  if (component[source] != component[target])
+    return result; // Different components, no path can exist
+
+  const double inf = std::numeric_limits<double>::infinity();
+  if (search.dist.size() != size_t(ids.size())) {
+    search.dist.assign(ids.size(), inf);
+    search.prev.assign(ids.size(), -1);
+    search.touched.clear();
+  }
+  for (int v : search.touched) {
+    search.dist[v] = inf;
+    search.prev[v] = -1;
+  }
+  search.touched.clear();
+
+  using Item = std::pair<double, int>;
+  std::priority_queue<Item, std::vector<Item>, std::greater<Item>> queue;
+  search.dist[source] = 0.0;
+  search.touched.push_back(source);
+  queue.push({0.0, source});
+
+  while (!queue.empty()) {
+    auto [d, v] = queue.top();
+    queue.pop();
+    if (d > search.dist[v])
+      continue;
+    if (v == target)
+      break;
+
+    for (int slot = offsets[v]; slot < offsets[v + 1]; ++slot) {
+      int w = targets[slot];
+      double nd = d + weights[slot];
+      if (nd < search.dist[w]) {
+        if (search.dist[w] == inf)
+          search.touched.push_back(w);
+        search.dist[w] = nd;
+        search.prev[w] = v;
+        queue.push({nd, w});
+      }
+    }
+  }
+
+  if (search.dist[target] == inf)
+    return result;
+
+  result.found = true;
+  result.distance = search.dist[target];
+  for (int v = target; v >= 0; v = search.prev[v])
+    result.path.append(ids[v]);
+  std::reverse(result.path.begin(), result.path.end());
+  return result;
+}
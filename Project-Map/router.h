@@ -0,0 +1,37 @@
+#pragma once
+#include "graph.h"
+#include <QHash>
+#include <QVector>
+#include <vector>
+
+struct RouteResult {
+  bool found = false;
+  double distance = 0.0; // Meters along the road network
+  QVector<qint64> path;  // Node ids from source to target
+};
+
+// Per-thread scratch memory for Router::route. Only the entries touched by
+// a query are reset, so one instance can serve millions of queries.
+struct RouteSearch {
+  std::vector<double> dist;
+  std::vector<int> prev;
+  std::vector<int> touched;
+};
+
+// Shortest paths over Graph::edges. The adjacency is packed into flat arrays
+// once, after which route() is read-only and safe to call from many threads.
+class Router {
+public:
+  explicit Router(const Graph &graph);
+
+  int nodeCount() const { return ids.size(); }
+  RouteResult route(qint64 from, qint64 to, RouteSearch &search) const;
+
+private:
+  QHash<qint64, int> index;
+  QVector<qint64> ids;
+  QVector<int> component; // Weak component per dense node
+  QVector<int> offsets;
+  QVector<int> targets;
+  QVector<float> weights;
+};
@@ -0,0 +1,101 @@
+#include "simplifier.h"
+#include <algorithm>
+#include <utility>
+
+namespace {
+
+double squaredSegmentDistance(const QPointF &p, const QPointF &a,
+                              const QPointF &b) {
+  const double dx = b.x() - a.x(), dy = b.y() - a.y();
+  const double len2 = dx * dx + dy * dy;
+  double t = 0.0;
+  if (len2 > 0)
+    t = std::clamp(((p.x() - a.x()) * dx + (p.y() - a.y()) * dy) / len2, 0.0,
+                   1.0);
+  const double ex = a.x() + t * dx - p.x(), ey = a.y() + t * dy - p.y();
+  return ex * ex + ey * ey;
+}
+
+// Marks the points of (first, last) that Douglas-Peucker keeps
+void simplifySection(const QVector<QPointF> &points, int first, int last,
+                     double tolerance2, QVector<bool> &keep) {
+  QVector<std::pair<int, int>> stack = {{first, last}};
+  while (!stack.isEmpty()) {
+    auto [a, b] = stack.takeLast();
+    int farthest = -1;
+    double farthestDist = tolerance2;
+    for (int i = a + 1; i < b; ++i) {
+      double d = squaredSegmentDistance(points[i], points[a], points[b]);
+      if (d > farthestDist) {
+        farthest = i;
+        farthestDist = d;
+      }
+    }
+    if (farthest < 0)
+      continue;
+    keep[farthest] = true;
+    stack.append({a, farthest});
+    stack.append({farthest, b});
+  }
+}
+
+} // namespace
+
+QVector<int> simplifyPolyline(const QVector<QPointF> &points, double tolerance,
+                              const QVector<bool> &pinned) {
+  const int n = points.size();
+  QVector<bool> keep = pinned.size() == n ? pinned : QVector<bool>(n, false);
+  if (n == 0)
+    return {};
+  keep[0] = keep[n - 1] = true;
+
+  // Pinned points split the line into sections simplified on their own
+  const double tolerance2 = tolerance * tolerance;
+  for (int first = 0, i = 1; i < n; ++i) {
+    if (keep[i]) {
+      simplifySection(points, first, i, tolerance2, keep);
+      first = i;
+    }
+  }
+
+  QVector<int> kept;
+  for (int i = 0; i < n; ++i) {
+    if (keep[i])
+      kept.append(i);
+  }
+  return kept;
+}
+
+QVector<QPointF> simplifyRing(const QVector<QPointF> &ring, double tolerance,
+                              const QVector<bool> &pinned) {
+  if (ring.size() < 4)
+    return ring;
+
+  // Anchor the far side of the ring too, otherwise a closed ring is one
+  // segment of zero length and collapses entirely
+  QVector<bool> anchors = pinned.size() == ring.size()
+                              ? pinned
+                              : QVector<bool>(ring.size(), false);
+  int farthest = 0;
+  double farthestDist = -1.0;
+  for (int i = 1; i < ring.size(); ++i) {
+    QPointF d = ring[i] - ring[0];
+    double dist = d.x() * d.x() + d.y() * d.y();
+    if (dist > farthestDist) {
+      farthest = i;
+      farthestDist = dist;
+    }
+  }
+  if (farthestDist <= tolerance * tolerance)
+    return {}; // Smaller than the tolerance, drop it
+  anchors[farthest] = true;
+
+  QVector<QPointF> out;
+  for (int i : simplifyPolyline(ring, tolerance, anchors))
+    out.append(ring[i]);
+
+  int distinct = out.size() - (out.size() > 1 && out.first() == out.last());
+  if (distinct < 3)
+    return {};
+  return out;
+}
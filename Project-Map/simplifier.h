@@ -0,0 +1,14 @@
+#pragma once
+#include <QPointF>
+#include <QVector>
+
+// Douglas-Peucker simplification. Returns the indices of the kept points in
+// order. Both ends and every point flagged in pinned are always kept, so
+// nodes shared with other features stay where those features expect them.
+QVector<int> simplifyPolyline(const QVector<QPointF> &points, double tolerance,
+                              const QVector<bool> &pinned = {});
+
+// Simplified copy of a closed ring. Rings that collapse below three distinct
+// points come back empty.
+QVector<QPointF> simplifyRing(const QVector<QPointF> &ring, double tolerance,
+                              const QVector<bool> &pinned = {});
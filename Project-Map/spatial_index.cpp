@@ -0,0 +1,112 @@
+#include "spatial_index.h"
+#include <algorithm>
+#include <cmath>
+
+void RTree::clear() {
+  boxes.clear();
+  items.clear();
+  levelStarts.clear();
+}
+
+QRectF RTree::bounds() const {
+  if (boxes.isEmpty())
+    return QRectF();
+  const Box &root = boxes.last();
+  return QRectF(QPointF(root.minX, root.minY), QPointF(root.maxX, root.maxY));
+}
+
+void RTree::build(const QVector<QRectF> &itemBoxes) {
+  clear();
+  const int n = itemBoxes.size();
+  if (n == 0)
+    return;
+
+  QVector<Box> leaves(n);
+  items.resize(n);
+  for (int i = 0; i < n; ++i) {
+    QRectF r = itemBoxes[i].normalized();
+    leaves[i] = {float(r.left()), float(r.top()), float(r.right()),
+                 float(r.bottom())};
+    items[i] = i;
+  }
+
+  // STR: sort by x center, cut into vertical slices of S * nodeSize entries,
+  // then sort each slice by y center so every run of nodeSize is compact.
+  auto centerX = [&](int i) { return leaves[i].minX + leaves[i].maxX; };
+  auto centerY = [&](int i) { return leaves[i].minY + leaves[i].maxY; };
+
+  int leafNodes = (n + nodeSize - 1) / nodeSize;
+  int slices = int(std::ceil(std::sqrt(double(leafNodes))));
+  int sliceSize = slices * nodeSize;
+
+  std::sort(items.begin(), items.end(),
+            [&](int a, int b) { return centerX(a) < centerX(b); });
+  for (int start = 0; start < n; start += sliceSize) {
+    int end = std::min(n, start + sliceSize);
+    std::sort(items.begin() + start, items.begin() + end,
+              [&](int a, int b) { return centerY(a) < centerY(b); });
+  }
+
+  boxes.reserve(n + n / (nodeSize - 1) + 1);
+  for (int item : items)
+    boxes.append(leaves[item]);
+
+  // Parents cover consecutive runs of nodeSize children until one root is left
+  levelStarts.append(0);
+  int levelStart = 0;
+  int levelEnd = boxes.size();
+  while (levelEnd - levelStart > 1) {
+    levelStarts.append(levelEnd);
+    for (int i = levelStart; i < levelEnd; i += nodeSize) {
+      Box parent = boxes[i];
+      for (int j = i + 1; j < std::min(levelEnd, i + nodeSize); ++j) {
+        parent.minX = std::min(parent.minX, boxes[j].minX);
+        parent.minY = std::min(parent.minY, boxes[j].minY);
+        parent.maxX = std::max(parent.maxX, boxes[j].maxX);
+        parent.maxY = std::max(parent.maxY, boxes[j].maxY);
+      }
+      boxes.append(parent);
+    }
+    levelStart = levelEnd;
+    levelEnd = boxes.size();
+  }
+  levelStarts.append(boxes.size());
+}
+
+void RTree::query(const QRectF &rect, QVector<int> &result) const {
+  if (boxes.isEmpty())
+    return;
+
+  QRectF r = rect.normalized();
+  const Box q = {float(r.left()), float(r.top()), float(r.right()),
+                 float(r.bottom())};
+
+  // Depth-first walk with an explicit stack of (level, node offset). Only
+  // nodes that intersect the query are pushed.
+  struct Entry {
+    int level;
+    int index;
+  };
+  Entry stack[32 * nodeSize];
+  int top = 0;
+  const int rootLevel = levelStarts.size() - 2;
+  if (boxes[levelStarts[rootLevel]].intersects(q))
+    stack[top++] = {rootLevel, levelStarts[rootLevel]};
+
+  while (top > 0) {
+    Entry e = stack[--top];
+    if (e.level == 0) {
+      result.append(items[e.index - levelStarts[0]]);
+      continue;
+    }
+
+    // Children of node k at this level are run k of the level below
+    int child = levelStarts[e.level - 1] +
+                (e.index - levelStarts[e.level]) * nodeSize;
+    int childEnd = std::min(levelStarts[e.level], child + nodeSize);
+    for (int c = childEnd - 1; c >= child; --c) {
+      if (boxes[c].intersects(q))
+        stack[top++] = {e.level - 1, c};
+    }
+  }
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include <QRectF>
+#include <QVector>
+
+// Static R-tree bulk loaded with Sort-Tile-Recursive packing. Built once over
+// feature bounding boxes, then queried every frame with the viewport. Nodes
+// are stored level by level in flat arrays, leaves first.
+class RTree {
+public:
+  static constexpr int nodeSize = 16;
+
+  void build(const QVector<QRectF> &itemBoxes);
+  void clear();
+  bool isEmpty() const { return items.isEmpty(); }
+  int size() const { return items.size(); }
+  QRectF bounds() const; // Box of the root node, empty when nothing is indexed
+
+  // Appends the index of every item whose box intersects rect
+  void query(const QRectF &rect, QVector<int> &result) const;
+
+private:
+  struct Box {
+    float minX, minY, maxX, maxY;
+    bool intersects(const Box &o) const {
+      return minX <= o.maxX && o.minX <= maxX && minY <= o.maxY &&
+             o.minY <= maxY;
+    }
+  };
+
+  QVector<Box> boxes;       // All levels, leaves first
+  QVector<int> items;       // Item index of each leaf entry
+  QVector<int> levelStarts; // Offset of each level in boxes, plus the end
+};
@@ -0,0 +1,189 @@
+#include "streaming_buffer.h"
+#include <QDebug>
+#include <QOpenGLContext>
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+// GL 4.4 / buffer_storage tokens, missing from older GL headers
+constexpr GLbitfield mapPersistentBit = 0x0040;
+constexpr GLbitfield mapCoherentBit = 0x0080;
+
+constexpr GLuint64 fenceTimeoutNanos = 1000000000; // Give up after a second
+
+using BufferStorage = void(QOPENGLF_APIENTRYP)(GLenum target, GLsizeiptr size,
+                                               const void *data,
+                                               GLbitfield flags);
+
+} // namespace
+
+void StreamingBuffer::initialize(qint64 size) {
+  QOpenGLContext *context = QOpenGLContext::currentContext();
+  const bool es = context->isOpenGLES();
+  const QPair<int, int> version = context->format().version();
+  if (version < (es ? qMakePair(3, 0) : qMakePair(3, 2))) {
+    qDebug() << "No fences or buffer copies, uploading geometry directly";
+    return;
+  }
+  initializeOpenGLFunctions();
+  ringSize = size;
+
+  // Step 1: Immutable storage mapped once for good, through the entry
+  // point QOpenGLExtraFunctions doesn't wrap
+  const bool hasStorage =
+      es ? context->hasExtension("GL_EXT_buffer_storage")
+         : version >= qMakePair(4, 4) ||
+               context->hasExtension("GL_ARB_buffer_storage");
+  BufferStorage bufferStorage =
+      hasStorage ? reinterpret_cast<BufferStorage>(context->getProcAddress(
+                       es ? "glBufferStorageEXT" : "glBufferStorage"))
+                 : nullptr;
+
+  glGenBuffers(1, &ring);
+  glBindBuffer(GL_COPY_READ_BUFFER, ring);
+  if (bufferStorage) {
+    const GLbitfield flags =
+        GL_MAP_WRITE_BIT | mapPersistentBit | mapCoherentBit;
+    bufferStorage(GL_COPY_READ_BUFFER, ringSize, nullptr, flags);
+    mapped = static_cast<char *>(
+        glMapBufferRange(GL_COPY_READ_BUFFER, 0, ringSize, flags));
+  }
+
+  // Step 2: Otherwise a plain buffer, mapped range by range
+  if (mapped) {
+    ringMode = PersistentMapping;
+  } else {
+    if (bufferStorage) { // Immutable storage can't be respecified
+      glDeleteBuffers(1, &ring);
+      glGenBuffers(1, &ring);
+      glBindBuffer(GL_COPY_READ_BUFFER, ring);
+    }
+    glBufferData(GL_COPY_READ_BUFFER, ringSize, nullptr, GL_STREAM_DRAW);
+    ringMode = RangeMapping;
+  }
+  glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+  qDebug() << "Streaming uploads through a" << ringSize / (1024 * 1024)
+           << "MB ring," << (mapped ? "persistently mapped" : "mapped per write");
+}
+
+void StreamingBuffer::cleanup() {
+  if (!isAvailable())
+    return;
+  for (const Region &region : inFlight)
+    glDeleteSync(region.fence);
+  inFlight.clear();
+  if (mapped) {
+    glBindBuffer(GL_COPY_READ_BUFFER, ring);
+    glUnmapBuffer(GL_COPY_READ_BUFFER);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    mapped = nullptr;
+  }
+  glDeleteBuffers(1, &ring);
+  ring = 0;
+  head = frameBegin = 0;
+  ringMode = Unavailable;
+}
+
+void StreamingBuffer::beginFrame() {
+  if (isAvailable()) {
+    fenceCurrent();
+
+    // Retire regions the GPU is done with, without waiting
+    while (!inFlight.empty() && glClientWaitSync(inFlight.front().fence, 0,
+                                                 0) != GL_TIMEOUT_EXPIRED) {
+      glDeleteSync(inFlight.front().fence);
+      inFlight.pop_front();
+    }
+  }
+
+  ++totals.frames;
+  totals.peakFrameBytes = std::max(totals.peakFrameBytes, currentFrameBytes);
+  currentFrameBytes = 0;
+}
+
+void StreamingBuffer::fenceCurrent() {
+  if (head == frameBegin)
+    return;
+  inFlight.push_back(
+      {frameBegin, head, glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0)});
+  frameBegin = head;
+}
+
+void StreamingBuffer::waitFor(const Region &region) {
+  if (glClientWaitSync(region.fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+    ++totals.stalls;
+    glClientWaitSync(region.fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                     fenceTimeoutNanos);
+  }
+  glDeleteSync(region.fence);
+}
+
+// Next aligned range of the ring, waiting for the GPU to finish reading
+// whatever was written there last time around
+qint64 StreamingBuffer::reserve(qint64 bytes) {
+  const qint64 size = (bytes + alignment - 1) / alignment * alignment;
+  qint64 start = head;
+  if (start + size > ringSize) {
+    // Regions never wrap: fence what this frame wrote so far, restart at 0
+    fenceCurrent();
+    start = frameBegin = 0;
+  }
+  const qint64 end = start + size;
+
+  auto blocked = [&] {
+    for (const Region &region : inFlight) {
+      if (region.begin < end && start < region.end)
+        return true;
+    }
+    return false;
+  };
+  while (blocked()) {
+    waitFor(inFlight.front());
+    inFlight.pop_front();
+  }
+
+  head = end;
+  return start;
+}
+
+bool StreamingBuffer::upload(GLuint buffer, qint64 offset, const void *data,
+                             qint64 bytes) {
+  if (!isAvailable() || bytes <= 0 || bytes > ringSize)
+    return false;
+
+  const qint64 start = reserve(bytes);
+  glBindBuffer(GL_COPY_READ_BUFFER, ring);
+  if (mapped) {
+    std::memcpy(mapped + start, data, bytes);
+  } else {
+    // The fences already keep this range out of the GPU's hands
+    void *range = glMapBufferRange(GL_COPY_READ_BUFFER, start, bytes,
+                                   GL_MAP_WRITE_BIT |
+                                       GL_MAP_INVALIDATE_RANGE_BIT |
+                                       GL_MAP_UNSYNCHRONIZED_BIT);
+    if (!range) {
+      glBindBuffer(GL_COPY_READ_BUFFER, 0);
+      return false;
+    }
+    std::memcpy(range, data, bytes);
+    glUnmapBuffer(GL_COPY_READ_BUFFER);
+  }
+
+  glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+  glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, start, offset,
+                      bytes);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+  glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+  countUpload(bytes);
+  ++totals.streamed;
+  return true;
+}
+
+void StreamingBuffer::countUpload(qint64 bytes) {
+  currentFrameBytes += bytes;
+  totals.bytes += bytes;
+  ++totals.uploads;
+}
@@ -0,0 +1,75 @@
+#pragma once
+#include <QOpenGLExtraFunctions>
+#include <QtGlobal>
+#include <deque>
+
+// Ring of staging memory for buffer uploads. Data is written into the ring
+// on the CPU and copied into its destination buffer by the GPU
+// (glCopyBufferSubData), so an upload never waits for buffers the GPU is
+// still drawing from. Each frame's writes are fenced; a ring region is only
+// rewritten once its fence has signaled, which in practice is always.
+//
+// The ring is persistently mapped when glBufferStorage is available
+// (GL 4.4, ARB/EXT_buffer_storage), otherwise each write maps its range
+// unsynchronized. Needs GL 3.2 or ES 3.0 for fences and buffer copies; on
+// older contexts isAvailable is false and callers upload directly. All
+// methods need the GL context to be current.
+class StreamingBuffer : protected QOpenGLExtraFunctions {
+public:
+  enum Mode { Unavailable, PersistentMapping, RangeMapping };
+
+  static constexpr qint64 defaultSize = 16ll * 1024 * 1024;
+  static constexpr qint64 alignment = 256;
+
+  void initialize(qint64 size = defaultSize);
+  void cleanup();
+  Mode mode() const { return ringMode; }
+  bool isAvailable() const { return ringMode != Unavailable; }
+
+  // Copies bytes into buffer (a GL buffer name) at offset. The buffer must
+  // already have its storage. False when the data doesn't fit the ring.
+  bool upload(GLuint buffer, qint64 offset, const void *data, qint64 bytes);
+
+  // Counts an upload made without the ring (too large, or unavailable)
+  // in the per-frame totals
+  void countUpload(qint64 bytes);
+
+  // Fences the writes of the frame just finished and starts counting the
+  // next one. Once per frame, before its first upload.
+  void beginFrame();
+
+  // Bytes uploaded per frame, and how often a write had to wait for the GPU
+  struct Stats {
+    qint64 frames = 0;
+    qint64 bytes = 0;
+    qint64 peakFrameBytes = 0;
+    qint64 uploads = 0;
+    qint64 streamed = 0; // Uploads that went through the ring
+    qint64 stalls = 0;
+  };
+  const Stats &stats() const { return totals; }
+  void resetStats() { totals = Stats(); }
+  qint64 frameBytes() const { return currentFrameBytes; }
+
+private:
+  // Written range of one frame, free again once fence signals
+  struct Region {
+    qint64 begin = 0;
+    qint64 end = 0;
+    GLsync fence = nullptr;
+  };
+
+  qint64 reserve(qint64 bytes);
+  void fenceCurrent();
+  void waitFor(const Region &region);
+
+  Mode ringMode = Unavailable;
+  GLuint ring = 0;
+  qint64 ringSize = 0;
+  char *mapped = nullptr; // Whole ring, PersistentMapping only
+  qint64 head = 0;        // Next write
+  qint64 frameBegin = 0;  // Start of the writes not fenced yet
+  std::deque<Region> inFlight; // Oldest first
+  qint64 currentFrameBytes = 0;
+  Stats totals;
+};
@@ -0,0 +1,121 @@
+#include "graph.h"
+#include "osm_loader.h"
+#include "raster_tiles.h"
+#include "web_tiles.h"
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+// Headless tile generator: loads a saved Overpass JSON file and renders a
+// z/x/y PNG pyramid of it on a worker pool, in the same style as the map
+// widget, reporting tiles per second.
+
+int main(int argc, char *argv[]) {
+  QCoreApplication app(argc, argv);
+  QCoreApplication::setApplicationName("MiniMapTiles");
+
+  QCommandLineParser parser;
+  parser.setApplicationDescription("Render a z/x/y PNG tile pyramid of a map");
+  parser.addHelpOption();
+  parser.addPositionalArgument("map", "Overpass JSON file to load");
+  parser.addPositionalArgument("output", "Directory to write z/x/y.png into");
+  QCommandLineOption threadsOption({"j", "threads"}, "Worker threads", "n",
+                                   QString::number(std::max(
+                                       1u, std::thread::hardware_concurrency())));
+  QCommandLineOption minZoomOption("min-zoom", "Lowest zoom level", "z", "12");
+  QCommandLineOption maxZoomOption("max-zoom", "Highest zoom level", "z", "17");
+  QCommandLineOption sizeOption("tile-size", "Tile size in pixels", "px",
+                                "256");
+  parser.addOption(threadsOption);
+  parser.addOption(minZoomOption);
+  parser.addOption(maxZoomOption);
+  parser.addOption(sizeOption);
+  parser.process(app);
+
+  const QStringList args = parser.positionalArguments();
+  if (args.size() != 2)
+    parser.showHelp(1);
+
+  // Step 1: Load the graph
+  QElapsedTimer timer;
+  timer.start();
+
+  QFile mapFile(args[0]);
+  if (!mapFile.open(QIODevice::ReadOnly)) {
+    fprintf(stderr, "Cannot open map file %s\n", qPrintable(args[0]));
+    return 1;
+  }
+
+  Graph graph;
+  OSMLoader loader(graph);
+  loader.loadAreasFromJSON(mapFile.readAll());
+  fprintf(stderr, "Loaded %d roads, %d buildings, %d areas in %lld ms\n",
+          int(graph.roads.size()), int(graph.buildings.size()),
+          int(graph.polygons.size()), timer.restart());
+
+  // Step 2: List the tiles and create their directories up front, so
+  // workers only render and write files
+  const int minZoom = std::clamp(parser.value(minZoomOption).toInt(), 0, 22);
+  const int maxZoom =
+      std::clamp(parser.value(maxZoomOption).toInt(), minZoom, 22);
+  const int tileSize = std::clamp(parser.value(sizeOption).toInt(), 64, 4096);
+  const QString outDir = args[1];
+
+  QVector<WebTile> tiles;
+  for (int z = minZoom; z <= maxZoom; ++z)
+    tiles += webTilesCovering(graph, z);
+  if (tiles.isEmpty()) {
+    fprintf(stderr, "Map is empty, no tiles to render\n");
+    return 1;
+  }
+
+  QDir dir;
+  for (const WebTile &tile : tiles) // mkpath is a no-op once a column exists
+    dir.mkpath(QString("%1/%2/%3").arg(outDir).arg(tile.z).arg(tile.x));
+
+  // Step 3: Render on the worker pool, one tile at a time
+  const int threadCount = std::max(1, parser.value(threadsOption).toInt());
+  std::atomic<int> nextTile{0};
+  std::atomic<int> failed{0};
+  std::atomic<qint64> pngBytes{0};
+
+  auto worker = [&]() {
+    for (int i = nextTile++; i < tiles.size(); i = nextTile++) {
+      const WebTile &tile = tiles[i];
+      const QString path = QString("%1/%2/%3/%4.png")
+                               .arg(outDir)
+                               .arg(tile.z)
+                               .arg(tile.x)
+                               .arg(tile.y);
+      if (!renderRasterTile(graph, tile, tileSize).save(path, "PNG")) {
+        ++failed;
+        continue;
+      }
+      pngBytes += QFileInfo(path).size();
+    }
+  };
+
+  std::vector<std::thread> workers;
+  for (int t = 0; t < threadCount; ++t)
+    workers.emplace_back(worker);
+  for (auto &thread : workers)
+    thread.join();
+
+  // Step 4: Report
+  const double seconds = timer.nsecsElapsed() / 1e9;
+  fprintf(stderr,
+          "%d tiles (z%d-%d) on %d threads in %.3f s (%.1f tiles/s), "
+          "%.1f MB written, %d failed\n",
+          int(tiles.size()), minZoom, maxZoom, threadCount, seconds,
+          seconds > 0 ? tiles.size() / seconds : 0.0, pngBytes / 1e6,
+          failed.load());
+  return failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,180 @@
+#include "tile_server.h"
+#include "mvt_encoder.h"
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QRunnable>
+#include <QTcpSocket>
+#include <algorithm>
+
+namespace {
+
+QByteArray httpResponse(int status, const char *reason,
+                        const QByteArray &contentType,
+                        const QByteArray &body) {
+  QByteArray out = "HTTP/1.0 " + QByteArray::number(status) + ' ' + reason +
+                   "\r\nContent-Type: " + contentType +
+                   "\r\nContent-Length: " + QByteArray::number(body.size()) +
+                   "\r\nAccess-Control-Allow-Origin: *"
+                   "\r\nConnection: close\r\n\r\n";
+  return out + body;
+}
+
+// Parses "/z/x/y.pbf" or "/z/x/y.mvt"
+bool parseTilePath(const QByteArray &path, WebTile &tile) {
+  QList<QByteArray> parts = path.split('/');
+  if (parts.size() != 4 || !parts[0].isEmpty())
+    return false;
+
+  QByteArray last = parts[3];
+  if (!last.endsWith(".pbf") && !last.endsWith(".mvt"))
+    return false;
+  last.chop(4);
+
+  bool okZ = false, okX = false, okY = false;
+  tile = {parts[1].toInt(&okZ), parts[2].toInt(&okX), last.toInt(&okY)};
+  return okZ && okX && okY && tile.z >= 0 && tile.z <= 22 && tile.x >= 0 &&
+         tile.y >= 0 && tile.x < (1 << tile.z) && tile.y < (1 << tile.z);
+}
+
+} // namespace
+
+// One connection, answered with blocking socket calls on a pool thread
+class TileRequest : public QRunnable {
+public:
+  TileRequest(TileServer &server, qintptr descriptor)
+      : server(server), descriptor(descriptor) {}
+
+  void run() override {
+    QTcpSocket socket;
+    if (!socket.setSocketDescriptor(descriptor))
+      return;
+
+    // Step 1: Read the request head, the body (if any) is ignored
+    QByteArray head;
+    while (!head.contains("\r\n\r\n") && head.size() < maxHeadSize) {
+      if (!socket.waitForReadyRead(timeoutMs))
+        return;
+      head += socket.readAll();
+    }
+
+    // Step 2: Answer the request line and close
+    const QList<QByteArray> request =
+        head.left(head.indexOf("\r\n")).split(' ');
+    const QByteArray response =
+        request.size() >= 2
+            ? server.respond(request[0], request[1])
+            : httpResponse(400, "Bad Request", "text/plain", "Bad request\n");
+    socket.write(response);
+    socket.waitForBytesWritten(timeoutMs);
+    socket.disconnectFromHost();
+    if (socket.state() != QAbstractSocket::UnconnectedState)
+      socket.waitForDisconnected(timeoutMs);
+  }
+
+private:
+  static constexpr int maxHeadSize = 8192;
+  static constexpr int timeoutMs = 5000;
+
+  TileServer &server;
+  qintptr descriptor;
+};
+
+TileServer::TileServer(const Graph &g, QObject *parent)
+    : QTcpServer(parent), graph(g) {
+  setCacheBytes(128ll * 1024 * 1024);
+}
+
+TileServer::~TileServer() { pool.waitForDone(); }
+
+void TileServer::setCacheBytes(qint64 bytes) {
+  QMutexLocker locker(&cacheMutex);
+  cache.setMaxCost(bytes);
+}
+
+void TileServer::incomingConnection(qintptr socketDescriptor) {
+  pool.start(new TileRequest(*this, socketDescriptor));
+}
+
+QByteArray TileServer::respond(const QByteArray &method,
+                               const QByteArray &path) {
+  if (method != "GET")
+    return httpResponse(405, "Method Not Allowed", "text/plain",
+                        "Only GET is supported\n");
+  if (path == "/stats")
+    return httpResponse(200, "OK", "application/json", statsJson());
+
+  WebTile webTile;
+  if (!parseTilePath(path, webTile))
+    return httpResponse(404, "Not Found", "text/plain", "No such tile\n");
+
+  const QByteArray body = tile(webTile);
+  if (++requests % statsInterval == 0)
+    logStats();
+  return httpResponse(200, "OK", "application/vnd.mapbox-vector-tile", body);
+}
+
+QByteArray TileServer::tile(const WebTile &webTile) {
+  {
+    QMutexLocker locker(&cacheMutex);
+    if (const QByteArray *cached = cache.object(webTile)) {
+      ++hits;
+      return *cached;
+    }
+  }
+
+  // Encode outside the lock so misses run in parallel
+  QElapsedTimer timer;
+  timer.start();
+  QByteArray data = encodeVectorTile(graph, webTile);
+  encodeNanos += timer.nsecsElapsed();
+  encodedBytes += data.size();
+  ++misses;
+
+  QMutexLocker locker(&cacheMutex);
+  cache.insert(webTile, new QByteArray(data), std::max<qsizetype>(1, data.size()));
+  return data;
+}
+
+TileServer::Stats TileServer::stats() const {
+  Stats s;
+  s.requests = requests;
+  s.hits = hits;
+  s.misses = misses;
+  s.encodeNanos = encodeNanos;
+  s.encodedBytes = encodedBytes;
+
+  QMutexLocker locker(&cacheMutex);
+  s.cachedBytes = cache.totalCost();
+  s.cachedTiles = int(cache.size());
+  return s;
+}
+
+QByteArray TileServer::statsJson() const {
+  const Stats s = stats();
+  const qint64 lookups = s.hits + s.misses;
+  QJsonObject json;
+  json["requests"] = s.requests;
+  json["hits"] = s.hits;
+  json["misses"] = s.misses;
+  json["hitRate"] = lookups > 0 ? double(s.hits) / lookups : 0.0;
+  json["encodeMsAvg"] = s.misses > 0 ? s.encodeNanos / 1e6 / s.misses : 0.0;
+  json["encodeTilesPerSecond"] =
+      s.encodeNanos > 0 ? s.misses / (s.encodeNanos / 1e9) : 0.0;
+  json["encodedBytes"] = s.encodedBytes;
+  json["cachedTiles"] = s.cachedTiles;
+  json["cachedBytes"] = s.cachedBytes;
+  return QJsonDocument(json).toJson(QJsonDocument::Compact) + '\n';
+}
+
+void TileServer::logStats() const {
+  const Stats s = stats();
+  const qint64 lookups = s.hits + s.misses;
+  qDebug().nospace() << s.requests << " tile requests, "
+                     << (lookups > 0 ? 100.0 * s.hits / lookups : 0.0)
+                     << "% cache hits, "
+                     << (s.misses > 0 ? s.encodeNanos / 1e6 / s.misses : 0.0)
+                     << " ms/encode, " << s.cachedTiles << " tiles ("
+                     << s.cachedBytes / 1024 << " KB) cached";
+}
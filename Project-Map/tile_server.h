@@ -0,0 +1,62 @@
+#pragma once
+#include "graph.h"
+#include "web_tiles.h"
+#include <QByteArray>
+#include <QCache>
+#include <QMutex>
+#include <QTcpServer>
+#include <QThreadPool>
+#include <atomic>
+
+// Small HTTP/1.0 server for vector tiles of a loaded graph. Each connection
+// is answered on a worker of the pool; encoded tiles are kept in an LRU
+// cache bounded in bytes. Routes:
+//   GET /z/x/y.pbf (or .mvt)  Mapbox Vector Tile, see mvt_encoder.h
+//   GET /stats                cache and encoder counters as JSON
+class TileServer : public QTcpServer {
+  Q_OBJECT
+
+public:
+  static constexpr int statsInterval = 1000; // Requests between log lines
+
+  explicit TileServer(const Graph &graph, QObject *parent = nullptr);
+  ~TileServer();
+
+  void setThreadCount(int count) { pool.setMaxThreadCount(count); }
+  void setCacheBytes(qint64 bytes);
+
+  // Cached or freshly encoded tile. Thread-safe; two threads missing the
+  // same tile at once both encode it.
+  QByteArray tile(const WebTile &tile);
+
+  struct Stats {
+    qint64 requests = 0;
+    qint64 hits = 0;
+    qint64 misses = 0;
+    qint64 encodeNanos = 0; // Summed over misses
+    qint64 encodedBytes = 0;
+    qint64 cachedBytes = 0;
+    int cachedTiles = 0;
+  };
+  Stats stats() const;
+  QByteArray statsJson() const;
+  void logStats() const;
+
+protected:
+  void incomingConnection(qintptr socketDescriptor) override;
+
+private:
+  friend class TileRequest;
+  QByteArray respond(const QByteArray &method, const QByteArray &path);
+
+  const Graph &graph;
+  QThreadPool pool;
+  mutable QMutex cacheMutex;
+  QCache<WebTile, QByteArray> cache; // Cost is the tile size in bytes
+
+  std::atomic<qint64> requests{0};
+  std::atomic<qint64> hits{0};
+  std::atomic<qint64> misses{0};
+  std::atomic<qint64> encodeNanos{0};
+  std::atomic<qint64> encodedBytes{0};
+};
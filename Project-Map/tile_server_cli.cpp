@@ -0,0 +1,113 @@
+#include "graph.h"
+#include "osm_loader.h"
+#include "tile_server.h"
+#include "web_tiles.h"
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QHostAddress>
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+// Local vector tile server: loads a saved Overpass JSON file and serves it
+// as Mapbox Vector Tiles on localhost. --warm encodes a zoom range up front
+// and reports encode throughput.
+
+int main(int argc, char *argv[]) {
+  QCoreApplication app(argc, argv);
+  QCoreApplication::setApplicationName("MiniMapTileServer");
+
+  QCommandLineParser parser;
+  parser.setApplicationDescription("Serve a map as vector tiles on localhost");
+  parser.addHelpOption();
+  parser.addPositionalArgument("map", "Overpass JSON file to load");
+  QCommandLineOption portOption({"p", "port"}, "Port to listen on", "port",
+                                "8080");
+  QCommandLineOption threadsOption({"j", "threads"}, "Worker threads", "n",
+                                   QString::number(std::max(
+                                       1u, std::thread::hardware_concurrency())));
+  QCommandLineOption cacheOption("cache-mb", "Tile cache size in MB", "mb",
+                                 "128");
+  QCommandLineOption warmOption("warm", "Encode zooms min-max before serving",
+                                "min-max");
+  parser.addOption(portOption);
+  parser.addOption(threadsOption);
+  parser.addOption(cacheOption);
+  parser.addOption(warmOption);
+  parser.process(app);
+
+  const QStringList args = parser.positionalArguments();
+  if (args.size() != 1)
+    parser.showHelp(1);
+
+  // Step 1: Load the graph
+  QElapsedTimer timer;
+  timer.start();
+
+  QFile mapFile(args[0]);
+  if (!mapFile.open(QIODevice::ReadOnly)) {
+    fprintf(stderr, "Cannot open map file %s\n", qPrintable(args[0]));
+    return 1;
+  }
+
+  Graph graph;
+  OSMLoader loader(graph);
+  loader.loadAreasFromJSON(mapFile.readAll());
+  fprintf(stderr, "Loaded %d roads, %d buildings, %d areas in %lld ms\n",
+          int(graph.roads.size()), int(graph.buildings.size()),
+          int(graph.polygons.size()), timer.restart());
+
+  const int threadCount = std::max(1, parser.value(threadsOption).toInt());
+  TileServer server(graph);
+  server.setThreadCount(threadCount);
+  server.setCacheBytes(
+      std::max(1ll, parser.value(cacheOption).toLongLong()) * 1024 * 1024);
+
+  // Step 2: Optionally fill the cache, timing the encoder
+  if (parser.isSet(warmOption)) {
+    const QStringList range = parser.value(warmOption).split('-');
+    const int minZoom = std::clamp(range.first().toInt(), 0, 22);
+    const int maxZoom = std::clamp(range.last().toInt(), minZoom, 22);
+
+    QVector<WebTile> tiles;
+    for (int z = minZoom; z <= maxZoom; ++z)
+      tiles += webTilesCovering(graph, z);
+
+    std::atomic<int> nextTile{0};
+    auto worker = [&]() {
+      for (int i = nextTile++; i < tiles.size(); i = nextTile++)
+        server.tile(tiles[i]);
+    };
+    timer.restart();
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threadCount; ++t)
+      workers.emplace_back(worker);
+    for (auto &thread : workers)
+      thread.join();
+
+    const double seconds = timer.nsecsElapsed() / 1e9;
+    const TileServer::Stats stats = server.stats();
+    fprintf(stderr,
+            "Encoded %d tiles (z%d-%d) on %d threads in %.3f s "
+            "(%.1f tiles/s), %.1f MB, %d kept in cache\n",
+            int(tiles.size()), minZoom, maxZoom, threadCount, seconds,
+            seconds > 0 ? tiles.size() / seconds : 0.0,
+            stats.encodedBytes / 1e6, stats.cachedTiles);
+  }
+
+  // Step 3: Serve
+  const quint16 port = quint16(parser.value(portOption).toUInt());
+  if (!server.listen(QHostAddress::LocalHost, port)) {
+    fprintf(stderr, "Cannot listen on port %d: %s\n", port,
+            qPrintable(server.errorString()));
+    return 1;
+  }
+  fprintf(stderr, "Serving http://localhost:%d/{z}/{x}/{y}.pbf (stats at "
+                  "/stats) with %d threads\n",
+          server.serverPort(), threadCount);
+  return app.exec();
+}
@@ -0,0 +1,202 @@
+#include "triangulator.h"
+#include <algorithm>
+#include <limits>
+
+namespace {
+
+// > 0 when a, b, c turn counter-clockwise
+double cross(const QPointF &a, const QPointF &b, const QPointF &c) {
+  return (b.x() - a.x()) * (c.y() - a.y()) - (b.y() - a.y()) * (c.x() - a.x());
+}
+
+double signedArea(const QVector<QPointF> &points, const QVector<int> &ring) {
+  double area = 0.0;
+  for (int i = 0, j = ring.size() - 1; i < ring.size(); j = i++) {
+    const QPointF &a = points[ring[j]];
+    const QPointF &b = points[ring[i]];
+    area += (a.x() - b.x()) * (a.y() + b.y());
+  }
+  return area / 2.0;
+}
+
+// Proper crossing of segments p1-p2 and q1-q2 (shared endpoints don't count)
+bool segmentsCross(const QPointF &p1, const QPointF &p2, const QPointF &q1,
+                   const QPointF &q2) {
+  if (p1 == q1 || p1 == q2 || p2 == q1 || p2 == q2)
+    return false;
+  double d1 = cross(q1, q2, p1), d2 = cross(q1, q2, p2);
+  double d3 = cross(p1, p2, q1), d4 = cross(p1, p2, q2);
+  return ((d1 > 0) != (d2 > 0)) && ((d3 > 0) != (d4 > 0));
+}
+
+bool segmentClear(const QVector<QPointF> &points, const QVector<int> &ring,
+                  const QPointF &a, const QPointF &b) {
+  for (int i = 0, j = ring.size() - 1; i < ring.size(); j = i++) {
+    if (segmentsCross(a, b, points[ring[j]], points[ring[i]]))
+      return false;
+  }
+  return true;
+}
+
+// Index ring of one input ring: drops a repeated closing vertex and orients
+// it counter-clockwise (outer) or clockwise (hole)
+QVector<int> makeRing(const QVector<QPointF> &points, int first, int count,
+                      bool counterClockwise) {
+  if (count > 1 && points[first] == points[first + count - 1])
+    --count;
+
+  QVector<int> ring(count);
+  for (int i = 0; i < count; ++i)
+    ring[i] = first + i;
+  if ((signedArea(points, ring) > 0) != counterClockwise)
+    std::reverse(ring.begin(), ring.end());
+  return ring;
+}
+
+// Splices a hole into the outer ring through a bridge from the hole's
+// leftmost vertex to the nearest outer vertex it can see
+void bridgeHole(const QVector<QPointF> &points, QVector<int> &ring,
+                const QVector<int> &hole) {
+  int h = 0;
+  for (int i = 1; i < hole.size(); ++i) {
+    if (points[hole[i]].x() < points[hole[h]].x())
+      h = i;
+  }
+  const QPointF &hp = points[hole[h]];
+
+  int best = -1;
+  double bestDist = std::numeric_limits<double>::max();
+  for (int pass = 0; pass < 2 && best < 0; ++pass) {
+    for (int k = 0; k < ring.size(); ++k) {
+      const QPointF &mp = points[ring[k]];
+      double d = (mp.x() - hp.x()) * (mp.x() - hp.x()) +
+                 (mp.y() - hp.y()) * (mp.y() - hp.y());
+      if (d >= bestDist)
+        continue;
+      // Second pass settles for the nearest vertex when none is visible
+      if (pass == 0 && (mp.x() > hp.x() || !segmentClear(points, ring, hp, mp) ||
+                        !segmentClear(points, hole, hp, mp)))
+        continue;
+      best = k;
+      bestDist = d;
+    }
+  }
+
+  QVector<int> merged;
+  merged.reserve(ring.size() + hole.size() + 2);
+  for (int k = 0; k <= best; ++k)
+    merged.append(ring[k]);
+  for (int i = 0; i <= hole.size(); ++i)
+    merged.append(hole[(h + i) % hole.size()]);
+  merged.append(ring[best]);
+  for (int k = best + 1; k < ring.size(); ++k)
+    merged.append(ring[k]);
+  ring.swap(merged);
+}
+
+bool isEar(const QVector<QPointF> &points, const QVector<int> &ring, int i) {
+  const int n = ring.size();
+  const QPointF &a = points[ring[(i + n - 1) % n]];
+  const QPointF &b = points[ring[i]];
+  const QPointF &c = points[ring[(i + 1) % n]];
+  if (cross(a, b, c) <= 0)
+    return false; // Reflex or degenerate corner
+
+  for (int k = 0; k < n; ++k) {
+    const QPointF &p = points[ring[k]];
+    if (p == a || p == b || p == c)
+      continue; // Includes bridge duplicates
+    if (cross(a, b, p) >= 0 && cross(b, c, p) >= 0 && cross(c, a, p) >= 0)
+      return false;
+  }
+  return true;
+}
+
+} // namespace
+
+QVector<quint32> triangulate(const QVector<QPointF> &outer,
+                             const QVector<QVector<QPointF>> &holes) {
+  QVector<quint32> triangles;
+
+  QVector<QPointF> points = outer;
+  QVector<int> ring = makeRing(points, 0, outer.size(), true);
+  if (ring.size() < 3)
+    return triangles;
+
+  // Step 1: Bridge holes in, left to right, so later bridges see earlier ones
+  QVector<QVector<int>> holeRings;
+  for (const auto &hole : holes) {
+    int first = points.size();
+    points += hole;
+    QVector<int> holeRing = makeRing(points, first, hole.size(), false);
+    if (holeRing.size() >= 3)
+      holeRings.append(holeRing);
+  }
+  auto leftmost = [&](const QVector<int> &r) {
+    double x = std::numeric_limits<double>::max();
+    for (int i : r)
+      x = std::min(x, points[i].x());
+    return x;
+  };
+  std::sort(holeRings.begin(), holeRings.end(),
+            [&](const QVector<int> &a, const QVector<int> &b) {
+              return leftmost(a) < leftmost(b);
+            });
+  for (const auto &holeRing : holeRings)
+    bridgeHole(points, ring, holeRing);
+
+  // Step 2: Clip ears, resuming next to the last one clipped
+  triangles.reserve((ring.size() - 2) * 3);
+  auto emitTriangle = [&](int i) {
+    const int n = ring.size();
+    triangles.append(ring[(i + n - 1) % n]);
+    triangles.append(ring[i]);
+    triangles.append(ring[(i + 1) % n]);
+    ring.removeAt(i);
+  };
+
+  int i = 0;
+  int misses = 0;
+  while (ring.size() > 3) {
+    const int n = ring.size();
+    i %= n;
+
+    if (isEar(points, ring, i)) {
+      emitTriangle(i);
+      i = std::max(0, i - 1);
+      misses = 0;
+      continue;
+    }
+
+    if (++misses < n) {
+      ++i;
+      continue;
+    }
+
+    // No ear found in a full lap: the ring is degenerate or self-intersecting.
+    // Drop a collinear vertex if there is one, otherwise force a convex clip.
+    misses = 0;
+    int fallback = -1;
+    for (int k = 0; k < n && fallback < 0; ++k) {
+      const QPointF &a = points[ring[(k + n - 1) % n]];
+      const QPointF &b = points[ring[k]];
+      const QPointF &c = points[ring[(k + 1) % n]];
+      if (cross(a, b, c) == 0)
+        fallback = k;
+    }
+    if (fallback >= 0) {
+      ring.removeAt(fallback);
+      continue;
+    }
+    for (int k = 0; k < n && fallback < 0; ++k) {
+      if (cross(points[ring[(k + n - 1) % n]], points[ring[k]],
+                points[ring[(k + 1) % n]]) > 0)
+        fallback = k;
+    }
+    emitTriangle(fallback >= 0 ? fallback : i);
+  }
+
+  if (ring.size() == 3)
+    emitTriangle(1);
+  return triangles;
+}
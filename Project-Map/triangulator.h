@@ -0,0 +1,11 @@
+#pragma once
+#include <QPointF>
+#include <QVector>
+
+// Ear-clipping triangulation of a simple polygon with holes. Holes are first
+// bridged into the outer ring, then ears are clipped until three vertices
+// are left. Returned indices address the outer ring followed by each hole in
+// order, exactly as passed in. Self-intersecting input still terminates,
+// possibly with a few overlapping triangles.
+QVector<quint32> triangulate(const QVector<QPointF> &outer,
+                             const QVector<QVector<QPointF>> &holes = {});
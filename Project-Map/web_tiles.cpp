@@ -0,0 +1,75 @@
+#include "web_tiles.h"
+#include <algorithm>
+#include <cmath>
+
+static double tileToLon(int x, int z) { return x / double(1 << z) * 360.0 - 180.0; }
+
+static double tileToLat(int y, int z) {
+  double n = M_PI * (1.0 - 2.0 * y / double(1 << z));
+  return std::atan(std::sinh(n)) * 180.0 / M_PI;
+}
+
+static int lonToTileX(double lon, int z) {
+  int x = int(std::floor((lon + 180.0) / 360.0 * (1 << z)));
+  return std::clamp(x, 0, (1 << z) - 1);
+}
+
+static int latToTileY(double lat, int z) {
+  double rad = lat * M_PI / 180.0;
+  double y = (1.0 - std::asinh(std::tan(rad)) / M_PI) / 2.0 * (1 << z);
+  return std::clamp(int(std::floor(y)), 0, (1 << z) - 1);
+}
+
+WebTileBounds webTileBounds(const WebTile &tile) {
+  return {tileToLon(tile.x, tile.z), tileToLat(tile.y + 1, tile.z),
+          tileToLon(tile.x + 1, tile.z), tileToLat(tile.y, tile.z)};
+}
+
+QVector<WebTile> webTilesCovering(const Graph &graph, int z) {
+  QVector<WebTile> tiles;
+  if (graph.minLon > graph.maxLon || graph.minLat > graph.maxLat)
+    return tiles; // Nothing loaded
+
+  const int x0 = lonToTileX(graph.minLon, z);
+  const int x1 = lonToTileX(graph.maxLon, z);
+  const int y0 = latToTileY(graph.maxLat, z); // North is the smaller y
+  const int y1 = latToTileY(graph.minLat, z);
+  for (int y = y0; y <= y1; ++y) {
+    for (int x = x0; x <= x1; ++x)
+      tiles.append({z, x, y});
+  }
+  return tiles;
+}
+
+// Normalized coordinates are x = (lon - minLon) * scale and
+// y = (lat - maxLat) * scale
+QRectF webTileMapRect(const Graph &graph, const WebTile &tile) {
+  const WebTileBounds b = webTileBounds(tile);
+  return QRectF(QPointF((b.west - graph.minLon) * graph.scale,
+                        (b.south - graph.maxLat) * graph.scale),
+                QPointF((b.east - graph.minLon) * graph.scale,
+                        (b.north - graph.maxLat) * graph.scale));
+}
+
+QTransform webTileTransform(const Graph &graph, const WebTile &tile,
+                            int extent) {
+  const WebTileBounds b = webTileBounds(tile);
+  const double sx = extent / (b.east - b.west);   // Pixels per degree
+  const double sy = extent / (b.north - b.south);
+  return QTransform(sx / graph.scale, 0, 0, -sy / graph.scale,
+                    (graph.minLon - b.west) * sx,
+                    (b.north - graph.maxLat) * sy);
+}
+
+float webTileZoom(const Graph &graph, const WebTile &tile, int extent) {
+  const WebTileBounds b = webTileBounds(tile);
+  return float(extent / (b.east - b.west) / graph.scale);
+}
+
+int lodForZoom(float zoom) {
+  for (int lod = 0; lod < Graph::lodLevels; ++lod) {
+    if (Graph::lodTolerance(lod) * zoom <= 0.5)
+      return lod;
+  }
+  return -1;
+}
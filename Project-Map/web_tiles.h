@@ -0,0 +1,46 @@
+#pragma once
+#include "graph.h"
+#include <QHash>
+#include <QRectF>
+#include <QTransform>
+#include <QVector>
+
+// Address of a standard z/x/y Web Mercator tile, y counting down from the
+// north edge
+struct WebTile {
+  int z = 0;
+  int x = 0;
+  int y = 0;
+
+  bool operator==(const WebTile &o) const {
+    return z == o.z && x == o.x && y == o.y;
+  }
+};
+
+inline size_t qHash(const WebTile &tile, size_t seed = 0) {
+  return qHashMulti(seed, tile.z, tile.x, tile.y);
+}
+
+// Lon/lat bounds of a tile, in degrees
+struct WebTileBounds {
+  double west, south, east, north;
+};
+
+WebTileBounds webTileBounds(const WebTile &tile);
+
+// Tiles of zoom z covering the graph's lon/lat bounds, row by row
+QVector<WebTile> webTilesCovering(const Graph &graph, int z);
+
+// Normalized map units (see Graph::normalizeCoordinates) covered by a tile
+QRectF webTileMapRect(const Graph &graph, const WebTile &tile);
+
+// Normalized map units to pixels of a tile extent pixels wide. Mercator is
+// linearized across the tile, exact at its edges so neighbours line up.
+QTransform webTileTransform(const Graph &graph, const WebTile &tile,
+                            int extent);
+
+// Pixels per map unit at this tile, the MapWidget zoom that looks the same
+float webTileZoom(const Graph &graph, const WebTile &tile, int extent);
+
+// Coarsest Graph level of detail within half a pixel at zoom, -1 for full
+int lodForZoom(float zoom);